@@ -0,0 +1,487 @@
+/**
+ * @file bench.cpp
+ * @brief Microbenchmarks of the parser phases, the evaluators and the node factory, over generated
+ *        corpora of expressions, and of the vector math kernels. Reports ns/op and ops/sec, writes
+ *        them as JSON, and compares them against a stored baseline.
+ * @author Guillermo M. Paris
+ * @date 2020-02-23
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "NodeFactory.h"
+#include "ArithmeticEvaluator.h"
+#include "CompactTree.h"
+#include "CompiledExpression.h"
+#include "ExpressionParser.h"
+#include "GammaFunction.h"
+#include "JitExpression.h"
+#include "OperationItem.h"
+#include "VectorMath.h"
+
+using Factory = NodeFactory<OperationItem>;
+using Clock = std::chrono::steady_clock;
+
+const int    corpusSize = 1000;  // expressions per corpus.
+const int    repetitions = 5;    // of every measure, the best one is reported.
+const double defaultMinTime = 0.1;  // seconds of a single repetition, at least.
+const double defaultThreshold = 25; // percent slower than the baseline to be a regression.
+
+// Access to the private phases of the parser, which its constructor runs all together.
+class ExpressionParserBench
+{
+public:
+    static size_t tokenize(ExpressionParser& parser, const char* pcExpr) // all the blocks, without the tree.
+    {
+        OperationId prevId = OperationId::openParenthesis;
+        int parenthesisBalance = 0;
+        size_t count = 0, total = 0;
+        parser.lastError = ExpressionParser::Error::success;
+        do
+            total += (count = parser.tokenize(pcExpr, prevId, parenthesisBalance));
+        while (count == ExpressionParser::tokenBlockSize && parser.lastError == ExpressionParser::Error::success);
+
+        return total;
+    }
+
+    static void parse(ExpressionParser& parser, const char* pcExpr)
+    {parser.lastError = ExpressionParser::Error::success; parser.parseExpression(pcExpr);}
+
+    static void destroyTree(ExpressionParser& parser) {parser.destroyTree();}
+};
+
+struct Corpus
+{
+    std::string              name;
+    std::vector<std::string> expressions;
+};
+
+struct Result
+{
+    std::string name;
+    double      nsPerOp;
+    double      opsPerSec;
+};
+
+class Generator // a tiny LCG, so every run (and machine) benchmarks the very same corpora.
+{
+public:
+    explicit Generator(uint32_t seed) : state(seed) {}
+    unsigned next(unsigned n) {state = state * 1664525u + 1013904223u; return (state >> 8) % n;}
+
+    std::string number()  {return std::to_string(1 + next(999)) + (next(4) == 0 ? "." + std::to_string(next(100)) : "");}
+    char binaryOp()       {return "+-*/"[next(4)];}
+
+private:
+    uint32_t state;
+};
+
+static std::string shortExpression(Generator& g)
+{
+    std::string s = g.number();
+    for (unsigned i = 0, n = 3 + g.next(4); i < n; i++)
+        s += std::string(" ") + g.binaryOp() + ' ' + g.number();
+    return s;
+}
+
+static std::string functionExpression(Generator& g)
+{
+    static const char* functions[] = {"sin", "cos", "tan", "exp", "sqrt", "ln", "atan", "curt", "tanh", "log"};
+    std::string s;
+    for (unsigned i = 0, n = 2 + g.next(3); i < n; i++)
+    {
+        if (i > 0)
+            s += std::string(" ") + g.binaryOp() + ' ';
+        s += std::string(functions[g.next(10)]) + '(' + g.number() + (g.next(2) ? " * pi" : "") + ')';
+    }
+    return s;
+}
+
+static std::string longExpression(Generator& g)
+{
+    std::string s = g.number();
+    for (unsigned i = 0; i < 100; i++)
+        s += g.binaryOp() + g.number();
+    return s;
+}
+
+static std::string nestedExpression(Generator& g)
+{
+    std::string s = g.number();
+    for (unsigned i = 0; i < 30; i++)
+        s = '(' + s + ' ' + g.binaryOp() + ' ' + g.number() + ')';
+    return s;
+}
+
+static std::vector<Corpus> makeCorpora()
+{
+    std::vector<Corpus> corpora = {{"short", {}}, {"functions", {}}, {"long", {}}, {"nested", {}}};
+    std::string (*generators[])(Generator&) = {shortExpression, functionExpression, longExpression, nestedExpression};
+    for (size_t c = 0; c < corpora.size(); c++)
+    {
+        Generator g(static_cast<uint32_t>(c + 1));
+        for (int i = 0; i < corpusSize; i++)
+            corpora[c].expressions.push_back(generators[c](g));
+    }
+
+    return corpora;
+}
+
+// Runs pass (which does ops operations) as many times as needed to last minTime, repetitions times,
+// and keeps the fastest repetition (the one less disturbed by the rest of the system).
+static Result measure(const std::string& name, size_t ops, double minTime, const std::function<void()>& pass)
+{
+    pass(); // warm up: caches, branch predictors, lazy allocations.
+    double bestNs = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        size_t passes = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0;
+        do
+        {
+            pass();
+            passes++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < minTime);
+
+        double ns = elapsed * 1e9 / double(passes * ops);
+        if (r == 0 || ns < bestNs)
+            bestNs = ns;
+    }
+
+    return {name, bestNs, 1e9 / bestNs};
+}
+
+// A timed phase whose setup must be redone before every pass (like destroying the trees to destroy).
+static Result measureWithSetup(const std::string& name, size_t ops, double minTime,
+                               const std::function<void()>& setup, const std::function<void()>& pass)
+{
+    double bestNs = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        size_t passes = 0;
+        double elapsed = 0;
+        do
+        {
+            setup();
+            Clock::time_point start = Clock::now();
+            pass();
+            elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+            passes++;
+        } while (elapsed < minTime);
+
+        double ns = elapsed * 1e9 / double(passes * ops);
+        if (r == 0 || ns < bestNs)
+            bestNs = ns;
+    }
+
+    return {name, bestNs, 1e9 / bestNs};
+}
+
+static void benchCorpus(const Corpus& corpus, double minTime, std::vector<Result>& results)
+{
+    const std::vector<std::string>& exprs = corpus.expressions;
+    size_t count = exprs.size();
+    volatile double sink = 0; // keeps the optimizer from discarding the evaluations.
+
+    Factory arena(Factory::Allocation::arena);
+    ExpressionParser parser("0", ExpressionParser::Verbosity::none, arena);
+    ExpressionParserBench::destroyTree(parser);
+
+    results.push_back(measure("tokenize/" + corpus.name, count, minTime, [&] () {
+        for (const std::string& e : exprs)
+            sink = sink + double(ExpressionParserBench::tokenize(parser, e.c_str()));
+    }));
+
+    results.push_back(measure("parseExpression/" + corpus.name, count, minTime, [&] () {
+        for (const std::string& e : exprs)
+        {
+            ExpressionParserBench::parse(parser, e.c_str());
+            ExpressionParserBench::destroyTree(parser); // an O(1) arena reset.
+        }
+    }));
+
+    ExpressionParser stackParser("0", ExpressionParser::Verbosity::none, arena, nullptr,
+                                 ExpressionParser::Engine::operatorStack);
+    ExpressionParserBench::destroyTree(stackParser);
+    results.push_back(measure("parseExpression[operatorStack]/" + corpus.name, count, minTime, [&] () {
+        for (const std::string& e : exprs)
+        {
+            ExpressionParserBench::parse(stackParser, e.c_str());
+            ExpressionParserBench::destroyTree(stackParser);
+        }
+    }));
+
+    Factory heap; // every tree alive at once, and destroyed node by node.
+    std::vector<std::unique_ptr<ExpressionParser>> parsers;
+    for (const std::string& e : exprs)
+        parsers.emplace_back(new ExpressionParser(e.c_str(), ExpressionParser::Verbosity::none, heap));
+
+    results.push_back(measure("evaluateNode/" + corpus.name, count, minTime, [&] () {
+        for (const std::unique_ptr<ExpressionParser>& p : parsers)
+            sink = sink + ArithmeticEvaluator(p->getTree()).getResult();
+    }));
+
+    std::vector<CompiledExpression> programs(count);
+    for (size_t i = 0; i < count; i++)
+        programs[i].compile(parsers[i]->getTree());
+
+    results.push_back(measure("CompiledExpression::evaluate/" + corpus.name, count, minTime, [&] () {
+        for (const CompiledExpression& program : programs)
+            sink = sink + program.evaluate();
+    }));
+
+    std::vector<CompactTree> compactTrees(count);
+    for (size_t i = 0; i < count; i++)
+        compactTrees[i].build(parsers[i]->getTree());
+
+    results.push_back(measure("CompactTree::evaluate/" + corpus.name, count, minTime, [&] () {
+        for (const CompactTree& compact : compactTrees)
+            sink = sink + compact.evaluate();
+    }));
+
+    if (JitExpression::isSupported())
+    {
+        std::vector<JitExpression> jits(count); // mapped once, never moved.
+        for (size_t i = 0; i < count; i++)
+            jits[i].compile(programs[i]);
+
+        results.push_back(measure("JitExpression::evaluate/" + corpus.name, count, minTime, [&] () {
+            for (const JitExpression& jit : jits)
+                sink = sink + jit.evaluate();
+        }));
+    }
+
+    bool parsed = true; // the trees of parsers are alive.
+    results.push_back(measureWithSetup("destroyTree/" + corpus.name, count, minTime, [&] () {
+        if (!parsed)
+            for (size_t i = 0; i < count; i++)
+                ExpressionParserBench::parse(*parsers[i], exprs[i].c_str());
+        parsed = true;
+    }, [&] () {
+        for (const std::unique_ptr<ExpressionParser>& p : parsers)
+            ExpressionParserBench::destroyTree(*p);
+        parsed = false;
+    }));
+
+    if (!parsed) // the parser destructors expect a tree.
+        for (size_t i = 0; i < count; i++)
+            ExpressionParserBench::parse(*parsers[i], exprs[i].c_str());
+}
+
+// The functions one value at a time through ArithmeticEvaluator (libm), against the SIMD kernels of VectorMath,
+// over the same arrays of arguments (within the domains of the kernels).
+static void benchVectorMath(double minTime, std::vector<Result>& results)
+{
+    const size_t count = 4096;
+    static const OperationId functions[] = {OperationId::sin, OperationId::tan, OperationId::exp, OperationId::ln,
+                                            OperationId::atan, OperationId::tanh, OperationId::asinh,
+                                            OperationId::cubroot, OperationId::gamma};
+    volatile double sink = 0;
+    std::vector<double> arguments(count), values(count);
+    for (size_t i = 0; i < count; i++)
+        arguments[i] = 0.05 + 9.9 * i / count;
+
+    for (OperationId id : functions)
+    {
+        std::string name = OperationItem::operandTable[static_cast<size_t>(id)].symbol;
+        results.push_back(measure("ArithmeticEvaluator::operate/" + name, count, minTime, [&] () {
+            for (size_t i = 0; i < count; i++)
+                values[i] = ArithmeticEvaluator::operate(id, 0.0, arguments[i]);
+            sink = sink + values[count - 1];
+        }));
+
+        results.push_back(measure("VectorMath::evaluate/" + name, count, minTime, [&] () {
+            VectorMath::evaluate(id, arguments.data(), values.data(), count);
+            sink = sink + values[count - 1];
+        }));
+
+        results.push_back(measure("VectorMath::evaluate/" + name + "@1e-7", count, minTime, [&] () {
+            VectorMath::evaluate(id, arguments.data(), values.data(), count, VectorMath::Precision::medium);
+            sink = sink + values[count - 1];
+        }));
+    }
+}
+
+static void benchGammaFunction(double minTime, std::vector<Result>& results)
+{
+    const size_t count = 4096;
+    volatile double sink = 0;
+    std::vector<double> integers(count), reals(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        integers[i] = static_cast<double>(i % (GammaFunction::maxFactorial + 1));
+        reals[i] = 0.05 + 9.9 * i / count;
+    }
+
+    results.push_back(measure("GammaFunction::factorial/integers", count, minTime, [&] () {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += GammaFunction::factorial(integers[i]);
+        sink = sink + sum;
+    }));
+
+    results.push_back(measure("GammaFunction::gamma/reals", count, minTime, [&] () {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += GammaFunction::gamma(reals[i]);
+        sink = sink + sum;
+    }));
+
+    results.push_back(measure("tgamma/reals", count, minTime, [&] () {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += std::tgamma(reals[i]);
+        sink = sink + sum;
+    }));
+}
+
+static void benchNodeFactory(double minTime, std::vector<Result>& results)
+{
+    const size_t nodes = 4096;
+    std::vector<Node<OperationItem>*> vNodes(nodes);
+    OperationItem item(OperationId::plus);
+
+    Factory heap;
+    results.push_back(measure("NodeFactory::createNode+destroyNode/heap", nodes, minTime, [&] () {
+        for (size_t i = 0; i < nodes; i++)
+            vNodes[i] = heap.createNode(item);
+        for (size_t i = 0; i < nodes; i++)
+            heap.destroyNode(vNodes[i]);
+    }));
+
+    Factory arena(Factory::Allocation::arena);
+    results.push_back(measure("NodeFactory::createNode+reset/arena", nodes, minTime, [&] () {
+        for (size_t i = 0; i < nodes; i++)
+            vNodes[i] = arena.createNode(item);
+        arena.reset();
+    }));
+}
+
+static bool writeJson(const char* path, const std::vector<Result>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "{\n  \"benchmarks\": [\n" << std::setprecision(6);
+    for (size_t i = 0; i < results.size(); i++)
+        file << "    {\"name\": \"" << results[i].name << "\", \"ns_per_op\": " << results[i].nsPerOp
+             << ", \"ops_per_sec\": " << std::fixed << std::setprecision(0) << results[i].opsPerSec
+             << std::defaultfloat << std::setprecision(6) << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    file << "  ]\n}\n";
+    return bool(file);
+}
+
+// Reads back the ns_per_op of every benchmark of a file written by writeJson().
+static bool readJson(const char* path, std::map<std::string, double>& nsPerOp)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t ns = line.find("\"ns_per_op\": ");
+        if (name == std::string::npos || ns == std::string::npos)
+            continue;
+
+        name += strlen("\"name\": \"");
+        nsPerOp[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + ns + strlen("\"ns_per_op\": "));
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* jsonPath = nullptr;
+    const char* baselinePath = nullptr;
+    double threshold = defaultThreshold;
+    double minTime = defaultMinTime;
+    bool strict = false; // regressions make it fail, not just reported.
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            minTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "--strict") == 0)
+            strict = true;
+        else
+        {
+            std::cout << "Usage: bench [--json <output file>] [--baseline <json file>] [--threshold <percent>]"
+                      << " [--min-time <seconds>] [--strict]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const Corpus& corpus : makeCorpora())
+        benchCorpus(corpus, minTime, results);
+    benchVectorMath(minTime, results);
+    benchGammaFunction(minTime, results);
+    benchNodeFactory(minTime, results);
+
+    std::map<std::string, double> baseline;
+    bool compare = (baselinePath != nullptr && readJson(baselinePath, baseline));
+    if (baselinePath != nullptr && !compare)
+        std::cout << "No baseline found at " << baselinePath << " , nothing to compare with"
+                  << " (make bench_baseline stores one).\n";
+
+    int regressions = 0;
+    std::cout << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(12) << "ns/op"
+              << std::setw(16) << "ops/sec" << (compare ? "    baseline    change" : "") << '\n';
+    for (const Result& r : results)
+    {
+        std::cout << std::left << std::setw(48) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.nsPerOp << std::setw(16) << std::setprecision(0) << r.opsPerSec;
+        auto found = baseline.find(r.name);
+        if (compare && found != baseline.end() && found->second > 0)
+        {
+            double change = (r.nsPerOp / found->second - 1) * 100; // positive is slower.
+            std::cout << std::setprecision(1) << std::setw(12) << found->second << std::showpos
+                      << std::setw(9) << change << '%' << std::noshowpos;
+            if (change > threshold)
+            {
+                std::cout << "  REGRESSION";
+                regressions++;
+            }
+        }
+        std::cout << '\n';
+    }
+
+    if (jsonPath != nullptr && !writeJson(jsonPath, results))
+    {
+        std::cout << "ERROR writing " << jsonPath << '\n';
+        return EXIT_FAILURE;
+    }
+
+    if (regressions > 0)
+    {
+        std::cout << regressions << " benchmark(s) more than " << threshold << "% slower than the baseline.\n";
+        if (strict)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -8,6 +8,7 @@
 #ifndef _ARITHMETICEVALUATOR_H
 #define _ARITHMETICEVALUATOR_H
 
+#include <unordered_map>
 #include "OperationId.h"
 #include "Tree.h"
 
@@ -15,21 +16,26 @@ struct OperationItem;
 
 class ArithmeticEvaluator
 {
+    static const unsigned maxRecursionDepth = 64; // the deeper levels are walked by a Tree iterator.
+
 public:
-    ArithmeticEvaluator(Tree<OperationItem>* ptree)
-    : lastError(0), pTree(ptree) {result = evaluateNode(ptree->getRoot());}
+    ArithmeticEvaluator(Tree<OperationItem>* ptree, const double* variables = nullptr);
 
     double getResult() {return result;}
     int    getError()  {return lastError;}
     operator bool()    {return lastError == 0;}
 
+    static double operate(OperationId id, double left, double right); // one operator over its operands.
+
 private:
-    double evaluateNode(const Node<OperationItem>* node);
-    double factorial(double n);
+    double evaluateNode(const Node<OperationItem>* node, unsigned depth = 0);
+    double evaluateSubtree(const Node<OperationItem>* top);
 
     int    lastError;
     double result;
     Tree<OperationItem>* pTree;
+    const double*        pVariables; // values of the variables, by their index.
+    std::unordered_map<const Node<OperationItem>*, double> sharedResults; // of a DAG, computed once.
 };
 
 #endif // _ARITHMETICEVALUATOR_H
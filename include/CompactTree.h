@@ -0,0 +1,56 @@
+/**
+ * @file CompactTree.h
+ * @brief Operand/operator/operand binary tree stored as a structure of arrays: the nodes in post-order,
+ *        their children as 32-bit indexes. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-15
+ */
+
+#ifndef _COMPACTTREE_H
+#define _COMPACTTREE_H
+
+#include <cstdint>
+#include <vector>
+#include "OperationId.h"
+#include "OperationItem.h"
+#include "Tree.h"
+
+// A node is its index into four parallel arrays: 17 bytes, instead of a Node<OperationItem> scattered
+// on the heap. The priority and the symbol of an operation are read from OperationItem::operandTable.
+// Children always come before their parents, and the root is the last node. A node shared by several
+// parents (a DAG) is stored once.
+class CompactTree
+{
+    static const size_t localResultsSize = 128; // bigger trees use heap allocated results.
+
+public:
+    static const uint32_t noChild = UINT32_MAX;
+
+    CompactTree() {}
+    explicit CompactTree(const Tree<OperationItem>* pTree) {build(pTree);}
+
+    bool        build(const Tree<OperationItem>* pTree);
+    double      evaluate(const double* variables = nullptr) const;
+
+    bool        isEmpty()                const {return vIds.empty();}
+    size_t      getSize()                const {return vIds.size();}
+    uint32_t    getRoot()                const {return static_cast<uint32_t>(vIds.size() - 1);}
+    OperationId getId(uint32_t node)     const {return vIds[node];}
+    double      getValue(uint32_t node)  const {return vValues[node];} // of a number, or a variable index.
+    uint32_t    getLeft(uint32_t node)   const {return vLeft[node];}
+    uint32_t    getRight(uint32_t node)  const {return vRight[node];}
+    char        getPriority(uint32_t node) const
+                {return OperationItem::operandTable[static_cast<size_t>(vIds[node])].priority;}
+    const char* getSymbol(uint32_t node) const
+                {return OperationItem::operandTable[static_cast<size_t>(vIds[node])].symbol;}
+
+private:
+    double      run(double* results, const double* variables) const;
+
+    std::vector<OperationId> vIds;
+    std::vector<double>      vValues;
+    std::vector<uint32_t>    vLeft;
+    std::vector<uint32_t>    vRight;
+};
+
+#endif // _COMPACTTREE_H
@@ -0,0 +1,70 @@
+/**
+ * @file CompiledExpression.h
+ * @brief Operand/operator/operand binary tree compiled into a flat postfix program,
+ *        and the stack machine running it. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-02
+ */
+
+#ifndef _COMPILEDEXPRESSION_H
+#define _COMPILEDEXPRESSION_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "OperationId.h"
+#include "Tree.h"
+#include "VectorMath.h"
+
+struct OperationItem;
+
+class CompiledExpression
+{
+    static const size_t localStackSize = 64; // deeper programs use a heap allocated stack.
+    static const size_t localBatchDepth = 16; // the same, for the stack of evaluate() over arrays.
+
+public:
+    static const size_t batchLanes = 16; // values evaluated together by evaluate() over arrays.
+    static constexpr OperationId storeShared = OperationId::openParenthesis; // parentheses never reach a program,
+    static constexpr OperationId loadShared = OperationId::closeParenthesis; // so their ids are the DAG opcodes.
+
+    struct Instruction
+    {
+        OperationId id;
+        uint32_t    operand; // constant pool index for OperationId::number, variable or shared result index.
+    };
+
+    CompiledExpression() : stackDepth(0), variableCount(0), sharedCount(0) {}
+    explicit CompiledExpression(const Tree<OperationItem>* pTree) : stackDepth(0), variableCount(0), sharedCount(0)
+                                                                   {compile(pTree);}
+
+    bool   compile(const Tree<OperationItem>* pTree);
+    double evaluate(const double* variables = nullptr) const;
+    void   evaluate(const double* const* variableArrays, double* results, size_t count,
+                    bool vectorMath = false, // the functions by VectorMath, a few ULP from libm,
+                    VectorMath::Precision precision = VectorMath::Precision::full) const; // or fewer digits.
+    bool   isEmpty()       const {return vCode.empty();}
+    size_t getSize()       const {return vCode.size();}
+    size_t getStackDepth() const {return stackDepth;}
+    size_t getVariableCount() const {return variableCount;} // highest variable index used + 1.
+    size_t getSharedCount()   const {return sharedCount;} // results of shared subtrees kept aside.
+    const std::vector<Instruction>& getCode()      const {return vCode;}
+    const std::vector<double>&      getConstants() const {return vConstants;}
+
+private:
+    bool   compileSubtree(const Node<OperationItem>* pTop);
+    void   emitConstant(double value, size_t depth);
+    void   emit(OperationId id, uint32_t operand, size_t depth);
+    double run(double* stack, const double* variables) const;
+    void   runBatch(double* stack, const double* const* variableArrays, size_t first, size_t lanes,
+                    double* results, bool vectorMath, VectorMath::Precision precision) const;
+
+    std::vector<Instruction> vCode;
+    std::vector<double>      vConstants;
+    size_t                   stackDepth; // maximum number of operands stacked at once.
+    size_t                   variableCount;
+    size_t                   sharedCount; // stored past the stack, at stack[stackDepth + index].
+    std::unordered_map<const Node<OperationItem>*, uint32_t> sharedIndexes; // while compiling only.
+};
+
+#endif // _COMPILEDEXPRESSION_H
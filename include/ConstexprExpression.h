@@ -0,0 +1,769 @@
+/**
+ * @file ConstexprExpression.h
+ * @brief Expression parsed at compile time into a postfix program: constant ones fold into a literal,
+ *        the ones with variables unroll into straight inlinable code. Interface and template file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-29
+ */
+
+#ifndef _CONSTEXPREXPRESSION_H
+#define _CONSTEXPREXPRESSION_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include "ArithmeticEvaluator.h"
+#include "DecimalConverter.h"
+#include "ExpressionParser.h"
+#include "GammaFunction.h"
+#include "OperationItem.h"
+
+// The grammar of ExpressionParser (same operators, function names, constants, quirks, errors and error positions),
+// built with the operator stack engine into arrays, and emitted as the postfix program of CompiledExpression.
+// Everything is constexpr but what cannot be: the number literals beyond Clinger's fast path (more than 2^53 or
+// 10^+-22, converted by DecimalConverter) and the functions of libm, so using them in a constant expression is a
+// compile error. Capacity is the size of the string literal (its terminating null included), deduced from it:
+//
+//     static constexpr ConstexprExpression seven("1 + 2*3");           // seven.evaluate() is a literal 7.
+//     static constexpr ConstexprExpression area("pi * r^2", {"r"});
+//     double a = evaluateUnrolled<area>(&radius);                      // no parsing, no loop, no switch.
+template<size_t Capacity>
+class ConstexprExpression
+{
+public:
+    using Error = ExpressionParser::Error;
+
+    struct Instruction
+    {
+        OperationId id;
+        uint32_t    position; // of the stack: where the result lands, which holds the left (or only) operand.
+        double      value;    // of a number, or the index of a variable.
+    };
+
+    constexpr ConstexprExpression(const char (&text)[Capacity], std::initializer_list<std::string_view> names = {})
+        : ConstexprExpression(std::string_view(text, Capacity - 1), names, 0) {}
+    constexpr ConstexprExpression(std::string_view text, std::initializer_list<std::string_view> names = {})
+        : ConstexprExpression(text, names, 0) {} // at run time too, with a text shorter than Capacity.
+
+    constexpr Error  getError()           const {return lastError;}
+    constexpr bool   finishedOK()         const {return lastError == Error::success;}
+    constexpr char   getFaultyChar()      const {return cLastParsed;}
+    constexpr int    getExpressionIndex() const {return lastIndex;}
+    constexpr size_t getSize()            const {return size;}
+    constexpr size_t getStackDepth()      const {return stackDepth;}
+    constexpr size_t getVariableCount()   const {return variableCount;}
+    constexpr const Instruction& getCode(size_t i) const {return code[i];}
+
+    constexpr double evaluate(const double* variables = nullptr) const;
+    static constexpr double operate(OperationId id, double left, double right);
+
+private:
+    enum class SearchStrategy : char {leftToRigth = 0, noIterate, rightToLeft};
+
+    struct Node
+    {
+        OperationId id;
+        double      value;
+        int         left;  // node index, or -1.
+        int         right;
+    };
+
+    struct Scanner
+    {
+        std::string_view text;
+        size_t           pos;
+
+        constexpr char at(size_t offset = 0) const {return pos + offset < text.size() ? text[pos + offset] : '\0';}
+    };
+
+    constexpr ConstexprExpression(std::string_view text, std::initializer_list<std::string_view> names, int);
+
+    constexpr bool parseNumberForward(double& returnValue, Scanner& s);
+    constexpr bool parseAlphabeticForward(OperationId& returnOp, Scanner& s);
+    constexpr bool parseVariableForward(unsigned& returnIndex, Scanner& s,
+                                        std::initializer_list<std::string_view> names) const;
+    constexpr bool parseNewItem(Scanner& s, SearchStrategy& newStrategy, OperationId& id, double& value,
+                                std::initializer_list<std::string_view> names);
+    constexpr void emitProgram(const Node* nodes, int root);
+    constexpr void emit(OperationId id, double value, size_t& sp);
+
+    static constexpr double toDouble(uint64_t digits, int64_t exponent);
+    static constexpr double reminder(double left, double right);
+    static constexpr bool   isLetter(char c) {return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');}
+    static constexpr char   priorityOf(OperationId id)
+                                {return OperationItem::operandTable[static_cast<size_t>(id)].priority;}
+
+    Error       lastError;
+    char        cLastParsed;
+    int         lastIndex;
+    size_t      size; // of the program.
+    size_t      stackDepth;
+    size_t      variableCount;
+    Instruction code[2 * Capacity]; // a missing operand (like in "1 + ") is a 0 without a character.
+};
+
+template<size_t Capacity>
+constexpr ConstexprExpression<Capacity>::ConstexprExpression(std::string_view text,
+                                                             std::initializer_list<std::string_view> names, int)
+    : lastError(Error::success), cLastParsed(0), lastIndex(0), size(0), stackDepth(0), variableCount(0), code{}
+{
+    assert(text.size() < Capacity); // every item is one character at least, so its node fits.
+
+    Scanner s = {text, 0};
+    if (s.at() == '\0')
+    {
+        lastError = Error::voidExpression; // no expression to parse.
+        return;
+    }
+
+    Node nodes[Capacity + 1] = {}; // the root '(' (an upward iteration stopper), then one per item.
+    int spine[Capacity + 1] = {};  // the operator stack: from the root down to the current node.
+    size_t nodeCount = 0, spineSize = 0;
+    OperationId prevId = OperationId::openParenthesis;
+    int parenthesisBalance = 0;
+    char c = 0;
+    while ((c = s.at()) != '\0')
+    {
+        if (c == ' ' ||  c == '\t' || c == '\r' || c == '\n')
+        {
+            s.pos++;
+            continue;
+        }
+
+        if (nodeCount == 0)
+        {
+            nodes[nodeCount++] = {OperationId::openParenthesis, 0.0, -1, -1};
+            spine[spineSize++] = 0;
+        }
+
+        if (c == ')' && parenthesisBalance == 0)
+        {
+            lastError = Error::noMatchingParenthesis; // no '(' to match, but the root one.
+            cLastParsed = c;
+            break;
+        }
+
+        SearchStrategy strategy = SearchStrategy::leftToRigth;
+        OperationId id = prevId; // parseNewItem() takes the former id from it.
+        double value = 0.0;
+        if (!parseNewItem(s, strategy, id, value, names))
+            break;
+
+        if (id == OperationId::openParenthesis)
+            parenthesisBalance++;
+        else if (id == OperationId::closeParenthesis)
+            parenthesisBalance--;
+        prevId = id;
+
+        char priority = priorityOf(id); // ExpressionParser::pushToken(), on arrays.
+        if (strategy == SearchStrategy::rightToLeft)
+            while (spineSize > 1 && priorityOf(nodes[spine[spineSize - 1]].id) < priority)
+                spineSize--;
+        else if (strategy == SearchStrategy::leftToRigth)
+            while (spineSize > 1 && priorityOf(nodes[spine[spineSize - 1]].id) <= priority)
+                spineSize--;
+
+        int current = spine[spineSize - 1];
+        if (id == OperationId::closeParenthesis) // the matching '(' is replaced by its right subtree.
+        {
+            spineSize--;
+            nodes[spine[spineSize - 1]].right = nodes[current].right;
+        }
+        else // hung on the right of the current node, and the right subtree of the latter on its left.
+        {
+            int newNode = static_cast<int>(nodeCount++);
+            nodes[newNode] = {id, value, nodes[current].right, -1};
+            nodes[current].right = newNode;
+            spine[spineSize++] = newNode;
+        }
+    }
+
+    if (lastError != Error::success)
+    {
+        lastIndex = static_cast<int>(s.pos);
+        for (; (c = s.at()) != '\0'; s.pos++)
+            parenthesisBalance += (c == '(' ? 1 : c == ')' ? -1 : 0);
+    }
+
+    if (nodeCount == 0)
+    {
+        lastError = Error::voidExpression; // void input expression
+        cLastParsed = ' ';
+        lastIndex = static_cast<int>(s.pos);
+    }
+    else if (parenthesisBalance != 0)
+    {
+        lastError = Error::noMatchingParenthesis; // no matching parenthesis found
+        cLastParsed = ' ';
+        lastIndex = static_cast<int>(s.pos);
+    }
+    else if (lastError == Error::success && nodes[0].right >= 0) // "()" leaves just the root '(', not a program.
+        emitProgram(nodes, nodes[0].right);
+}
+
+// ExpressionParser::parseNumberForward().
+template<size_t Capacity>
+constexpr bool ConstexprExpression<Capacity>::parseNumberForward(double& returnValue, Scanner& s)
+{
+    const int maxNumberOfDigits = 20;
+    bool decimalPoint = false;
+    bool engNotation = false;
+    bool negativeExponent = false;
+    char c = s.at();
+    int digitCount = 0;
+    uint64_t digits = 0;
+    int64_t  exponent = 0;
+    int64_t  engExponent = 0;
+
+    do
+    {
+        if (c == '.')
+        {
+            if (decimalPoint || engNotation)
+            {
+                lastError = Error::incorrectDecimalPoint; // two decimal points, or one in the exponent.
+                cLastParsed = c;
+                return false;
+            }
+
+            decimalPoint = true;
+        }
+        else if (c == 'e' || c == 'E')
+        {
+            if (engNotation)
+                break; // the second 'E' is left to the next item.
+
+            char cNext = s.at(1);
+            if (('0' <= cNext && cNext <= '9') || cNext == '+' || cNext == '-')
+            {
+                engNotation = true;
+                negativeExponent = (cNext == '-');
+                if ('0' <= cNext && cNext <= '9')
+                    engExponent = cNext - '0';
+
+                s.pos += 2;
+                digitCount += 2;
+                c = s.at();
+                continue;
+            }
+            else // not an engineering notation mark, but the next item.
+                break;
+        }
+        else if (engNotation)
+        {
+            engExponent = engExponent * 10 + (c - '0');
+            digitCount++;
+        }
+        else
+        {
+            digits = digits * 10 + static_cast<unsigned>(c - '0');
+            if (decimalPoint)
+                exponent--;
+            digitCount++;
+        }
+
+        s.pos++;
+        c = s.at();
+    }
+    while ((('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E') && digitCount < maxNumberOfDigits);
+
+    if (digitCount >= maxNumberOfDigits)
+    {
+        lastError = Error::tooManyDigits; // too many decimal digits.
+        cLastParsed = c;
+        return false;
+    }
+
+    exponent += (negativeExponent ? -engExponent : engExponent);
+    returnValue = toDouble(digits, exponent);
+    return true;
+}
+
+// DecimalConverter::toDouble(), whose fast path is constexpr: an exact integer times (or over) an exact power of ten
+// is rounded once, at compile time as at run time. The other literals are only converted at run time.
+template<size_t Capacity>
+constexpr double ConstexprExpression<Capacity>::toDouble(uint64_t digits, int64_t exponent)
+{
+    constexpr double exactPowersOfTen[23] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    if (digits == 0 || exponent < DecimalConverter::minExponent)
+        return 0.0;
+    else if (exponent > DecimalConverter::maxExponent)
+        return std::numeric_limits<double>::infinity();
+
+    if (digits <= (uint64_t(1) << 53) && -22 <= exponent && exponent <= 22)
+    {
+        double value = static_cast<double>(digits);
+        return exponent < 0 ? value / exactPowersOfTen[-exponent] : value * exactPowersOfTen[exponent];
+    }
+
+    return DecimalConverter::toDouble(digits, exponent); // not a constant expression.
+}
+
+// ExpressionParser::parseAlphabeticForward(), the function names looked up in OperationItem::operandTable.
+template<size_t Capacity>
+constexpr bool ConstexprExpression<Capacity>::parseAlphabeticForward(OperationId& returnOp, Scanner& s)
+{
+    char name[6] = {0};
+    name[0] = s.at();
+    name[1] = s.at(1);
+    if (!isLetter(name[1]))
+    {
+        if (name[0] == 'e') // just one letter => Euler number
+        {
+            s.pos++;
+            returnOp = OperationId::e;
+            return true;
+        }
+
+        s.pos++;
+        cLastParsed = name[1];
+        lastError = Error::unknownChar;
+        return false;
+    }
+
+    name[2] = s.at(2);
+    if (!isLetter(name[2]) && name[2] != '(')
+    {
+        if (name[0] == 'p' && name[1] == 'i') // just two letters => Pitágoras number
+        {
+            s.pos += 2;
+            returnOp = OperationId::pi;
+            return true;
+        }
+
+        s.pos += 2;
+        cLastParsed = name[2];
+        lastError = Error::unknownChar;
+        return false;
+    }
+
+    size_t nameLength = 2;
+    if (name[2] != '(')
+    {
+        nameLength++;
+        name[3] = s.at(3);
+        if (!isLetter(name[3]) && name[3] != '(')
+        {
+            if (name[0] == 'p' && name[1] == 'h' && name[2] == 'i') // just three letters => Armonic number
+            {
+                s.pos += 3;
+                returnOp = OperationId::phi;
+                return true;
+            }
+
+            s.pos += 3;
+            cLastParsed = name[3];
+            lastError = Error::unknownChar;
+            return false;
+        }
+
+        if (name[3] != '(')
+        {
+            nameLength++;
+            if ((name[4] = s.at(4)) != '(') // bad finished function name
+            {
+                cLastParsed = name[0];
+                lastError = Error::unknownFunction;
+                return false;
+            }
+        }
+        else
+            name[3] = 0;
+    }
+    else
+        name[2] = 0;
+
+    for (size_t u = static_cast<size_t>(OperationId::firstFunction); u <= static_cast<size_t>(OperationId::lastFunction);
+         u++)
+    {
+        const char* symbol = OperationItem::operandTable[u].symbol;
+        size_t i = 0;
+        while (i < OperationItem::symbolLength && symbol[i] != '\0' && symbol[i] == name[i])
+            i++;
+
+        if ((i == OperationItem::symbolLength || symbol[i] == '\0') && (i == 4 || name[i] == '\0'))
+        {
+            s.pos += nameLength;
+            returnOp = OperationItem::operandTable[u].id;
+            return true;
+        }
+    }
+
+    cLastParsed = name[0];
+    lastError = Error::unknownFunction;
+    return false;
+}
+
+// ExpressionParser::parseVariableForward().
+template<size_t Capacity>
+constexpr bool ConstexprExpression<Capacity>::parseVariableForward(unsigned& returnIndex, Scanner& s,
+                                                                   std::initializer_list<std::string_view> names) const
+{
+    if (names.size() == 0)
+        return false;
+
+    size_t length = 0;
+    char c = 0;
+    while ((c = s.at(length)) != 0 && (isLetter(c) || (length > 0 && (('0' <= c && c <= '9') || c == '_'))))
+        length++;
+
+    if (c == '(')
+        return false; // a function call, not a variable.
+
+    unsigned u = 0;
+    for (std::string_view name : names)
+    {
+        if (name == s.text.substr(s.pos, length))
+        {
+            s.pos += length;
+            returnIndex = u;
+            return true;
+        }
+        u++;
+    }
+
+    return false;
+}
+
+// ExpressionParser::parseNewItem(), the former id given in id.
+template<size_t Capacity>
+constexpr bool ConstexprExpression<Capacity>::parseNewItem(Scanner& s, SearchStrategy& newStrategy, OperationId& id,
+                                                           double& value, std::initializer_list<std::string_view> names)
+{
+    char c = s.at();
+    OperationId prevId = id;
+    id = OperationId::number;
+    value = 0;
+
+    if (c == '(')
+    {
+        id = OperationId::openParenthesis;
+        newStrategy = SearchStrategy::noIterate;
+    }
+    else if (c == ')')
+    {
+        id = OperationId::closeParenthesis;
+        newStrategy = SearchStrategy::rightToLeft;
+    }
+    else if (c == '+' || c == '-')
+    {
+        if (prevId == OperationId::number || prevId == OperationId::variable
+            || prevId == OperationId::factorial || prevId == OperationId::closeParenthesis)
+            id = (c == '+' ? OperationId::plus : OperationId::minus);
+        else // unary operators + or -
+        {
+            id = (c == '+' ? OperationId::positive : OperationId::negative);
+            newStrategy = SearchStrategy::noIterate;
+        }
+    }
+    else if (c == '*' || c == '/' || c == '%' || c == '^' || c == '!')
+    {
+        if (prevId != OperationId::number && prevId != OperationId::variable
+            && prevId != OperationId::closeParenthesis)
+        {
+            lastError = Error::contiguousOp;
+            cLastParsed = c;
+            return false;
+        }
+
+        if (c == '*')
+            id = OperationId::multiply;
+        else if (c == '/')
+            id = OperationId::divide;
+        else if (c == '%')
+            id = OperationId::reminder;
+        else if (c == '^')
+        {
+            id = OperationId::power;
+            newStrategy = SearchStrategy::rightToLeft;
+        }
+        else // '!'
+            id = OperationId::factorial;
+    }
+    else if (('0' <= c && c <= '9') || c == '.')
+        return parseNumberForward(value, s);
+    else if (isLetter(c))
+    {
+        if (prevId == OperationId::number || prevId == OperationId::variable)
+        {
+            lastError = Error::missingOp;
+            cLastParsed = c;
+            return false;
+        }
+
+        unsigned variableIndex = 0;
+        if (parseVariableForward(variableIndex, s, names))
+        {
+            id = OperationId::variable;
+            value = variableIndex;
+            return true;
+        }
+
+        OperationId opId = OperationId::openParenthesis;
+        if (!parseAlphabeticForward(opId, s))
+            return false;
+
+        if (opId == OperationId::pi)
+            value = 0x1.921fb54442d18p+1;  // 4 * atan(1)
+        else if (opId == OperationId::phi)
+            value = 0x1.9e3779b97f4a8p+0;  // (1 + sqrt(5)) / 2
+        else if (opId == OperationId::e)
+            value = 0x1.5bf0a8b145769p+1;  // exp(1)
+        else
+            id = opId;
+        return true;
+    }
+    else
+    {
+        lastError = Error::unknownChar;
+        cLastParsed = c;
+        return false;
+    }
+
+    s.pos++;
+    return true;
+}
+
+// CompiledExpression::compileNode(), walked with an explicit stack of nodes (a missing operand is -1).
+template<size_t Capacity>
+constexpr void ConstexprExpression<Capacity>::emitProgram(const Node* nodes, int root)
+{
+    struct Frame
+    {
+        int      node;
+        unsigned operand; // the next one to emit.
+    };
+
+    Frame frames[Capacity + 2] = {};
+    size_t frameCount = 0, sp = 0;
+    frames[frameCount++] = {root, 0};
+    while (frameCount > 0)
+    {
+        Frame& frame = frames[frameCount - 1];
+        if (frame.node < 0)
+        {
+            emit(OperationId::number, 0.0, sp);
+            frameCount--;
+            continue;
+        }
+
+        const Node& node = nodes[frame.node];
+        OperationId id = node.id;
+        int operands[2] = {-1, -1};
+        unsigned operandCount = 0;
+        if (id == OperationId::number || id == OperationId::variable)
+            ;
+        else if ((OperationId::firstFunction <= id && id <= OperationId::lastFunction)
+                 || id == OperationId::positive || id == OperationId::negative)
+            operands[operandCount++] = node.right;
+        else if (id == OperationId::factorial)
+            operands[operandCount++] = node.left;
+        else // power to reminder, plus and minus.
+        {
+            operands[operandCount++] = node.left;
+            operands[operandCount++] = node.right;
+        }
+
+        if (frame.operand < operandCount)
+        {
+            int operand = operands[frame.operand++];
+            frames[frameCount++] = {operand, 0};
+            continue;
+        }
+
+        emit(id, node.value, sp);
+        frameCount--;
+    }
+}
+
+template<size_t Capacity>
+constexpr void ConstexprExpression<Capacity>::emit(OperationId id, double value, size_t& sp)
+{
+    if (id == OperationId::number || id == OperationId::variable)
+    {
+        code[size++] = {id, static_cast<uint32_t>(sp++), value};
+        if (id == OperationId::variable && static_cast<size_t>(value) + 1 > variableCount)
+            variableCount = static_cast<size_t>(value) + 1;
+        if (sp > stackDepth)
+            stackDepth = sp;
+    }
+    else if ((OperationId::power <= id && id <= OperationId::reminder) || id == OperationId::plus
+             || id == OperationId::minus)
+        code[size++] = {id, static_cast<uint32_t>(--sp - 1), 0.0};
+    else
+        code[size++] = {id, static_cast<uint32_t>(sp - 1), 0.0};
+}
+
+template<size_t Capacity>
+constexpr double ConstexprExpression<Capacity>::evaluate(const double* variables /* = nullptr */) const
+{
+    if (size == 0)
+        return 0.0;
+
+    double stack[Capacity + 1] = {};
+    for (size_t i = 0; i < size; i++)
+    {
+        const Instruction& instr = code[i];
+        double& top = stack[instr.position];
+        if (instr.id == OperationId::number)
+            top = instr.value;
+        else if (instr.id == OperationId::variable)
+            top = (variables != nullptr ? variables[static_cast<size_t>(instr.value)] : 0.0);
+        else if (instr.id == OperationId::factorial)
+            top = operate(instr.id, top, 0.0);
+        else if ((OperationId::power <= instr.id && instr.id <= OperationId::reminder)
+                 || instr.id == OperationId::plus || instr.id == OperationId::minus)
+            top = operate(instr.id, top, stack[instr.position + 1]);
+        else
+            top = operate(instr.id, 0.0, top);
+    }
+
+    return stack[0];
+}
+
+// ArithmeticEvaluator::operate(), constexpr for the arithmetic operators, for the powers which are exact
+// integers, for the factorials and for gama of the integers (looked up, as at run time). The rest (libm) is
+// only computed at run time.
+template<size_t Capacity>
+constexpr double ConstexprExpression<Capacity>::operate(OperationId id, double left, double right)
+{
+    switch (id)
+    {
+    case OperationId::multiply:
+        return left * right;
+
+    case OperationId::divide:
+        return left / right;
+
+    case OperationId::plus:
+        return left + right;
+
+    case OperationId::minus:
+        return left - right;
+
+    case OperationId::negative:
+        return -right;
+
+    case OperationId::positive: // + absolute value
+        return (right > 0 ? right : -right);
+
+    case OperationId::reminder:
+        return reminder(left, right);
+
+    case OperationId::power: // pow() is exact when the result is an integer up to 2^53.
+    {
+        const double maxExact = 9007199254740992.0;
+        if (right == 0)
+            return 1.0;
+        if (0 < right && right <= 64 && right == static_cast<int>(right)
+            && -maxExact <= left && left <= maxExact && left == static_cast<int64_t>(left))
+        {
+            double result = 1.0;
+            for (int n = static_cast<int>(right); n > 0 && -maxExact <= result && result <= maxExact; n--)
+                result *= left;
+            if (-maxExact <= result && result <= maxExact)
+                return result;
+        }
+        return ArithmeticEvaluator::operate(id, left, right); // not a constant expression.
+    }
+
+    case OperationId::factorial: // GammaFunction::factorial(): the table of the integers, or gamma(left + 1).
+        if (0 <= left && left <= GammaFunction::maxFactorial && left == static_cast<size_t>(left))
+            return GammaFunction::factorialOf(static_cast<size_t>(left));
+        if (left + 1.0 > GammaFunction::maxArgument)
+            return std::numeric_limits<double>::infinity();
+        return ArithmeticEvaluator::operate(id, left, right); // not a constant expression.
+
+    case OperationId::gamma:
+        if (1 <= right && right <= GammaFunction::maxFactorial + 1 && right == static_cast<size_t>(right))
+            return GammaFunction::factorialOf(static_cast<size_t>(right) - 1);
+        if (right > GammaFunction::maxArgument)
+            return std::numeric_limits<double>::infinity();
+        return ArithmeticEvaluator::operate(id, left, right); // not a constant expression.
+
+    default:
+        return ArithmeticEvaluator::operate(id, left, right); // not a constant expression.
+    }
+}
+
+// fmod(), which is exact: the divisor times a power of two is subtracted while it fits (Sterbenz lemma).
+template<size_t Capacity>
+constexpr double ConstexprExpression<Capacity>::reminder(double left, double right)
+{
+    const double infinity = std::numeric_limits<double>::infinity();
+    double x = (left < 0 ? -left : left);
+    double y = (right < 0 ? -right : right);
+    if (left != left || right != right || x == infinity || y == 0)
+        return ArithmeticEvaluator::operate(OperationId::reminder, left, right); // NaN, signed as the FPU does.
+    if (x < y || y == infinity)
+        return left;
+
+    double r = x;
+    while (r >= y)
+    {
+        double scaled = y;
+        while (scaled <= r / 2) // doubling is exact, and r - scaled too, being scaled <= r < 2 * scaled.
+            scaled *= 2;
+        r -= scaled;
+    }
+
+    return (left < 0 ? -r : r); // the sign of the dividend, even for a zero.
+}
+
+// The program of a static ConstexprExpression unrolled into straight code: one statement per instruction, on stack
+// positions known at compile time (registers, once optimized), for the compiler to inline into the caller.
+template<const auto& expression, size_t I>
+inline void evaluateStep(double* stack, const double* variables)
+{
+    constexpr auto instr = expression.getCode(I);
+    constexpr size_t p = instr.position;
+    if constexpr (instr.id == OperationId::number)
+        stack[p] = instr.value;
+    else if constexpr (instr.id == OperationId::variable)
+        stack[p] = (variables != nullptr ? variables[static_cast<size_t>(instr.value)] : 0.0);
+    else if constexpr (instr.id == OperationId::multiply)
+        stack[p] = stack[p] * stack[p + 1];
+    else if constexpr (instr.id == OperationId::divide)
+        stack[p] = stack[p] / stack[p + 1];
+    else if constexpr (instr.id == OperationId::plus)
+        stack[p] = stack[p] + stack[p + 1];
+    else if constexpr (instr.id == OperationId::minus)
+        stack[p] = stack[p] - stack[p + 1];
+    else if constexpr (instr.id == OperationId::negative)
+        stack[p] = -stack[p];
+    else if constexpr (instr.id == OperationId::factorial)
+        stack[p] = expression.operate(instr.id, stack[p], 0.0);
+    else if constexpr (instr.id == OperationId::power || instr.id == OperationId::reminder)
+        stack[p] = expression.operate(instr.id, stack[p], stack[p + 1]);
+    else // functions and unary +, over their right operand.
+        stack[p] = expression.operate(instr.id, 0.0, stack[p]);
+}
+
+template<const auto& expression, size_t... I>
+inline double evaluateSteps(const double* variables, std::index_sequence<I...>)
+{
+    double stack[expression.getStackDepth()];
+    (evaluateStep<expression, I>(stack, variables), ...);
+    return stack[0];
+}
+
+template<const auto& expression>
+inline double evaluateUnrolled(const double* variables = nullptr)
+{
+    static_assert(expression.finishedOK(), "the expression does not parse, see getError() and getExpressionIndex()");
+    if constexpr (expression.getSize() == 0)
+        return 0.0;
+    else
+        return evaluateSteps<expression>(variables, std::make_index_sequence<expression.getSize()>());
+}
+
+#endif // _CONSTEXPREXPRESSION_H
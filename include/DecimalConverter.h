@@ -0,0 +1,30 @@
+/**
+ * @file DecimalConverter.h
+ * @brief Correctly rounded conversion of a decimal number (digits * 10^exponent) into a double,
+ *        without allocations nor locales, by the Eisel-Lemire algorithm. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-08
+ */
+
+#ifndef _DECIMALCONVERTER_H
+#define _DECIMALCONVERTER_H
+
+#include <cstdint>
+
+class DecimalConverter
+{
+public:
+    static const int minExponent = -342; // under it, any 64 bit digits are rounded to 0.
+    static const int maxExponent = 308;  // over it, any (not zero) digits overflow to infinity.
+
+    static double toDouble(uint64_t digits, int64_t exponent); // the nearest double, ties to even.
+
+private:
+    static bool   eiselLemire(uint64_t digits, int64_t exponent, double& value);
+    static double fallback(uint64_t digits, int64_t exponent);
+
+    static const double   exactPowersOfTen[23]; // 10^0 .. 10^22, exactly representable as doubles.
+    static const uint64_t powersOfFive[maxExponent - minExponent + 1][2]; // 128 bits, the high half first.
+};
+
+#endif // _DECIMALCONVERTER_H
@@ -0,0 +1,79 @@
+/**
+ * @file ExpressionCache.h
+ * @brief Thread safe LRU cache of evaluated (and optionally compiled) expressions, keyed by
+ *        a normalized form of the expression. Split in shards, each with its own lock. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-16
+ */
+
+#ifndef _EXPRESSIONCACHE_H
+#define _EXPRESSIONCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Tree.h"
+
+struct OperationItem;
+class CompiledExpression;
+
+class ExpressionCache
+{
+public:
+    static const size_t defaultShards = 16;
+
+    struct Entry
+    {
+        double result;
+        std::shared_ptr<const CompiledExpression> pProgram; // null if it was not compiled.
+    };
+
+    struct Statistics
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t   entries;
+    };
+
+    explicit ExpressionCache(size_t capacity, size_t shards = defaultShards);
+    ExpressionCache(const ExpressionCache&) = delete;
+
+    // A hit always counts, a miss only with countMiss: just the last key tried for an expression counts it as missed.
+    bool   find(const std::string& key, Entry& entry, bool countMiss = true);
+    void   insert(const std::string& key, const Entry& entry); // the least recently used one may go away.
+    size_t getCapacity() const {return capacity;}
+    Statistics getStatistics() const;
+
+    // The two kinds of keys never collide, as they start with a different character.
+    static std::string normalize(const char* pcExpr, size_t length); // the text, its white space runs as one.
+    static std::string canonicalForm(const Tree<OperationItem>* pTree); // commutative operands sorted.
+
+private:
+    using Item = std::pair<std::string, Entry>;
+
+    struct Shard
+    {
+        mutable std::mutex mtx;
+        size_t capacity; // its share of the total one.
+        std::list<Item> lruItems; // the most recently used first.
+        std::unordered_map<std::string, std::list<Item>::iterator> index;
+    };
+
+    Shard& shardOf(const std::string& key) {return vShards[std::hash<std::string>()(key) % vShards.size()];}
+
+    size_t                capacity;
+    std::vector<Shard>    vShards;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+};
+
+#endif // _EXPRESSIONCACHE_H
@@ -9,18 +9,25 @@
 #ifndef _EXPRESSIONPARSER_H
 #define _EXPRESSIONPARSER_H
 
+#include <cstdint>
 #include <iostream>
-#include <unordered_map>
+#include <string>
+#include <vector>
 #include "OperationId.h"
 #include "Tree.h"
 
 struct OperationItem;
+template<class Data> class NodeFactory;
 
 class ExpressionParser
 {
+    friend class ExpressionParserBench; // bench/src/bench.cpp times the private phases one by one.
+
     static const int rootMargin = 2;
     static const int indentMargin = 8;
     static const int maxNumberOfDigits = 20; // for max of uint_64_t
+    static const size_t tokenBlockSize = 32; // tokens read ahead of the tree building.
+    static const unsigned maxRecursionDepth = 64; // destroyNode() walks the deeper levels with a Tree iterator.
 
 public:
 
@@ -36,11 +43,25 @@ public:
         none = 0, partial, full, extra
     };
 
+    enum class Engine // how the tree is built; both of them build the very same tree.
+    {
+        treeClimbing = 0, // every item climbs up the tree from the current node, through the parent links.
+        operatorStack     // the path from the root to the current node is an explicit stack, just popped.
+    };
+
+    using VariableNames = std::vector<std::string>; // the position of a name is its variable index.
+
     ExpressionParser() = delete;
+    ExpressionParser(const ExpressionParser&) = delete;
     ExpressionParser(const char* pcExpr, Verbosity v);
-    ~ExpressionParser()                     {if(pTree != nullptr) destroyTree();}
+    ExpressionParser(const char* pcExpr, Verbosity v, NodeFactory<OperationItem>& factory,
+                     const VariableNames* pVariables = nullptr, Engine e = Engine::treeClimbing);
+    ExpressionParser(const char* pcExpr, size_t length, Verbosity v, NodeFactory<OperationItem>& factory,
+                     const VariableNames* pVariables = nullptr, Engine e = Engine::treeClimbing);
+    ~ExpressionParser();
 
     Tree<OperationItem>* getTree()    const {return pTree;}
+    NodeFactory<OperationItem>* getNodeFactory() const {return pFactory;}
     Error getError()                  const {return lastError;}
     int   getIntError()               const {return static_cast<int>(lastError);}
     bool  finishedOK()                const {return lastError == Error::success;}
@@ -62,26 +83,47 @@ private:
         rightToLeft
     };
 
-    void  populateFunctionNamesTable();
-    const char* expressionSanityCheck(const char* pcExpression);
+    struct Token // an item as read from the expression: its kind and its span there (nothing copied).
+    {
+        double         value;  // of a number, or the index of a variable.
+        uint32_t       offset; // from the beginning of the expression.
+        uint32_t       length;
+        OperationId    id;
+        SearchStrategy strategy;
+    };
+
+    char  charAt(const char* p) const {return (pcEnd == nullptr || p < pcEnd) ? *p : '\0';}
     bool  parseNumberForward(double& returnValue, const char* & currentLine);
     bool  parseAlphabeticForward(OperationId& returnOp, const char* & currentLine);
+    bool  parseVariableForward(unsigned& returnIndex, const char* & currentLine) const;
     bool  parseNewItem(const char* & currentLine, SearchStrategy& newStrategy, OperationItem* newItemToComplete);
+    size_t tokenize(const char* & currentLine, OperationId& prevId, int& parenthesisBalance);
+    int   scanParenthesis(const char* & currentLine) const;
+    void  insertToken(const Token& token);
+    void  pushToken(const Token& token, std::vector<Node<OperationItem>*>& vSpine);
     void  parseExpression(const char* pcExpression);
     void  removeFakeOpenParenthesisRoot();
     void  printNode(const Node<OperationItem>* node, int indent, std::ostream& os, bool norecursive = false) const;
-    void  destroyNode(Node<OperationItem>* const node, bool norecursive = false);
+    void  printItem(const Node<OperationItem>* node, int indent, std::ostream& os) const;
+    void  destroyNode(Node<OperationItem>* const node, bool norecursive = false, unsigned depth = 0);
+    void  destroySubtree(Node<OperationItem>* const top);
     void  destroyTree();
 
     static const char*  errors[static_cast<size_t>(Error::total)];
 
     Verbosity      verbosity;
+    Engine         engine;
     Error          lastError;
     char           cLastParsed;
     int            lastIndex;
     const char*    szExpression;
-    Tree<OperationItem>* pTree;
-    std::unordered_map<uint32_t, OperationId> functionNames;
+    const char*    pcEnd; // end of a not null terminated expression (a line view), or nullptr.
+    const VariableNames* pVariableNames; // declared variables, if any.
+    NodeFactory<OperationItem>* pFactory; // either injected by the caller, or owned by this parser.
+    bool           ownFactory;
+    Tree<OperationItem>  tree; // embedded, so a parser allocates nothing by itself.
+    Tree<OperationItem>* pTree; // &tree while there is a parsed tree, otherwise nullptr.
+    Token          tokens[tokenBlockSize]; // the current block of tokens, inserted into the tree while hot.
 };
 
 #endif // _EXPRESSIONPARSER_H
\ No newline at end of file
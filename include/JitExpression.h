@@ -0,0 +1,87 @@
+/**
+ * @file JitExpression.h
+ * @brief Operand/operator/operand binary tree compiled into x86-64 machine code. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-22
+ */
+
+#ifndef _JITEXPRESSION_H
+#define _JITEXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include "OperationId.h"
+#include "Tree.h"
+
+class CompiledExpression;
+struct OperationItem;
+
+// The postfix program of a CompiledExpression lowered to SSE2 code, in a buffer mapped writable while it is
+// written and then only executable (W^X). + - * / and the negation are inlined, the libm functions are called
+// directly and the remaining operators through ArithmeticEvaluator::operate(), so that the results are the
+// very same bits than the ones of ArithmeticEvaluator. Unless fused multiply-add is asked for (and the CPU has
+// it): then a*b+c, c+a*b, a*b-c and c-a*b are rounded once, which is usually more precise, but different.
+class JitExpression
+{
+    static const size_t maxFrameSlots = 8192; // operands and shared results kept on the machine stack, at most.
+
+public:
+    using Function = double (*)(const double* variables); // variables may be null, then they are all 0.
+
+    JitExpression() : pCode(nullptr), mappedSize(0), codeSize(0), fused(false) {}
+    explicit JitExpression(const Tree<OperationItem>* pTree, bool fusedMultiplyAdd = false)
+                          : pCode(nullptr), mappedSize(0), codeSize(0), fused(false)
+                          {compile(pTree, fusedMultiplyAdd);}
+    JitExpression(const JitExpression&) = delete;
+    JitExpression& operator = (const JitExpression&) = delete;
+    ~JitExpression() {release();}
+
+    bool     compile(const Tree<OperationItem>* pTree, bool fusedMultiplyAdd = false);
+    bool     compile(const CompiledExpression& program, bool fusedMultiplyAdd = false);
+    Function getFunction() const {return reinterpret_cast<Function>(pCode);} // null unless compiled.
+    double   evaluate(const double* variables = nullptr) const {return pCode ? getFunction()(variables) : 0.0;}
+
+    bool     isEmpty()     const {return pCode == nullptr;}
+    size_t   getCodeSize() const {return codeSize;} // bytes of machine code, without the constants.
+    bool     isFused()     const {return fused;} // fused multiply-add really used.
+
+    static bool isSupported(); // an x86-64 build, where executable memory can be mapped.
+    static bool hasFusedMultiplyAdd(); // of the running CPU.
+
+private:
+    static const int firstStackRegister = 3; // xmm0 to xmm2 are scratch registers (the arguments, the result).
+    static const size_t stackRegisters = 13; // the first operands of the stack live in xmm3 to xmm15.
+
+    enum class Base : char {rsp, rbx, rip}; // the stack frame, the variables and the constants.
+
+    struct Fixup // a RIP relative displacement, to patch once the data offset is known.
+    {
+        size_t   position;
+        uint32_t dataOffset;
+    };
+
+    void release();
+    void lower(const CompiledExpression& program);
+    int  locate(size_t position, int scratch);
+    void settle(size_t position, int reg);
+    void spill(size_t positions, bool restore);
+    void load(int reg, OperationId id, uint32_t operand, size_t stackDepth);
+    void callFunction(uintptr_t function);
+    void emitSse(uint8_t prefix, uint8_t opcode, int reg, int rm);
+    void emitSseMemory(uint8_t prefix, uint8_t opcode, int reg, Base base, uint32_t displacement);
+    void emitFused(uint8_t opcode, int reg, int vreg, int rm);
+    void emit(std::initializer_list<uint8_t> bytes) {vBytes.insert(vBytes.end(), bytes);}
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+
+    void*                pCode;
+    size_t               mappedSize;
+    size_t               codeSize;
+    bool                 fused;
+    std::vector<uint8_t> vBytes; // while compiling only.
+    std::vector<Fixup>   vFixups;
+};
+
+#endif // _JITEXPRESSION_H
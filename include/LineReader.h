@@ -0,0 +1,58 @@
+/**
+ * @file LineReader.h
+ * @brief Reader of one expression per line, from a file or the standard input.
+ *        Regular files are memory mapped and their lines handed out in place (no copies);
+ *        other inputs are read through a fixed, reused buffer. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-01-19
+ */
+
+#ifndef _LINEREADER_H
+#define _LINEREADER_H
+
+#include <cstddef>
+#include <vector>
+
+class LineReader
+{
+    static const size_t bufferSize = 1024 * 1024; // initial size of the stream buffer.
+    static const size_t releaseStep = 4 * 1024 * 1024; // mapped bytes consumed before giving them back.
+
+public:
+    struct Line
+    {
+        const char* text; // not null terminated.
+        size_t      length;
+    };
+
+    LineReader();
+    LineReader(const LineReader&) = delete;
+    ~LineReader()                          {close();}
+
+    bool   open(const char* path, bool keepEmpty = false); // "-" opens the standard input. Empty lines are skipped,
+                                                             // unless kept (as lines of length 0).
+    void   close();
+    bool   isMapped() const                {return pMap != nullptr;}
+    size_t readLines(std::vector<Line>& lines, size_t maxLines);
+
+private:
+    bool   mapFile();
+    size_t readMappedLines(std::vector<Line>& lines, size_t maxLines);
+    size_t readStreamLines(std::vector<Line>& lines, size_t maxLines);
+    void   addLine(std::vector<Line>& lines, const char* text, size_t length);
+    void   releaseConsumedPages();
+
+    int               fd;
+    bool              ownFd;
+    const char*       pMap;
+    size_t            mapSize;
+    size_t            mapOffset;   // first byte not handed out yet.
+    size_t            mapReleased; // bytes already given back to the system.
+    std::vector<char> buffer;
+    size_t            bufferBegin; // first byte not handed out yet.
+    size_t            bufferEnd;   // first free byte.
+    bool              endOfInput;
+    bool              keepEmptyLines;
+};
+
+#endif // _LINEREADER_H
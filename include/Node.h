@@ -21,12 +21,14 @@ public:
     Node* getLeft()       const     {return pLeft;}
     Node* getParent()     const     {return pParent;}
     Node* getRight()      const     {return pRight;}
+    bool  isShared()      const     {return shared != 0;} // reached from more than one parent (a DAG node).
 
     void  setData(const Data& d)    {data = d;}
     void  setData(Data&& d)         {data = d;}
     void  setLeft(Node* const pl)   {pLeft = pl;}
     void  setParent(Node* const pp) {pParent = pp;}
     void  setRight(Node* const pr)  {pRight = pr;}
+    void  setShared(bool s)         {shared = s ? 1 : 0;}
 
     bool  isLeftChildOf(Node* const pn)  const {return pn->pLeft == this && pn == pParent;}
     bool  isParentOf(Node* const pn)     const {return (pLeft == pn || pRight == pn)
@@ -37,12 +39,12 @@ public:
 
 private:
     Node() = delete;
-    Node(const Data& d, unsigned n) : pLeft(nullptr), pParent(nullptr), pRight(nullptr), data(d), nSequence(n) {}
-    Node(const Data& d, unsigned n, Node* pp) : pLeft(nullptr), pParent(pp), pRight(nullptr), data(d), nSequence(n) {}
-    Node(const Data& d, unsigned n, Node* pl, Node* pp, Node* pr) : pLeft(pl), pParent(pp), pRight(pr), data(d), nSequence(n) {}
-    Node(Data&& d, unsigned n) : pLeft(nullptr), pParent(nullptr), pRight(nullptr), data(d), nSequence(n) {}
-    Node(Data&& d, unsigned n, Node* pp) : pLeft(nullptr), pParent(pp), pRight(nullptr), data(d), nSequence(n) {}
-    Node(Data&& d, unsigned n, Node* pl, Node* pp, Node* pr) : pLeft(pl), pParent(pp), pRight(pr), data(d), nSequence(n) {}
+    Node(const Data& d, unsigned n) : pLeft(nullptr), pParent(nullptr), pRight(nullptr), data(d), nSequence(n), nSlot(0), shared(0) {}
+    Node(const Data& d, unsigned n, Node* pp) : pLeft(nullptr), pParent(pp), pRight(nullptr), data(d), nSequence(n), nSlot(0), shared(0) {}
+    Node(const Data& d, unsigned n, Node* pl, Node* pp, Node* pr) : pLeft(pl), pParent(pp), pRight(pr), data(d), nSequence(n), nSlot(0), shared(0) {}
+    Node(Data&& d, unsigned n) : pLeft(nullptr), pParent(nullptr), pRight(nullptr), data(d), nSequence(n), nSlot(0), shared(0) {}
+    Node(Data&& d, unsigned n, Node* pp) : pLeft(nullptr), pParent(pp), pRight(nullptr), data(d), nSequence(n), nSlot(0), shared(0) {}
+    Node(Data&& d, unsigned n, Node* pl, Node* pp, Node* pr) : pLeft(pl), pParent(pp), pRight(pr), data(d), nSequence(n), nSlot(0), shared(0) {}
     ~Node() {} // this Tree implementation does not allocate anything.
 
     Node*        pLeft;
@@ -50,6 +52,8 @@ private:
     Node*        pRight;
     Data         data;
     unsigned int nSequence;
+    unsigned int nSlot : 31; // bookkeeping slot into the factory, recycled once the node is destroyed.
+    unsigned int shared : 1; // its only owner is pParent, the other parents just refer to it.
 };
 
 #endif // _NODE_H
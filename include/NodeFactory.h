@@ -10,15 +10,34 @@
 #define _NODEFACTORY_H
 
 #include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 #include "Node.h"
 
 template<class Data>
 class NodeFactory
 {
 public:
-    static NodeFactory* getOrCreateInstance();
-    static void         destroyInstance();
+    enum class Allocation : char
+    {
+        heap = 0, // one heap allocation per node, every node released one by one.
+        arena     // nodes bumped from big chunks, all of them released at once by reset().
+    };
+
+    NodeFactory(Allocation a = Allocation::heap, bool useHugePages = false);
+    NodeFactory(const NodeFactory&) = delete;
+    NodeFactory& operator = (const NodeFactory&) = delete;
+    ~NodeFactory() {destroyAll(); releaseArenaChunks();}
+
+    Allocation  getAllocation()  const {return allocation;}
+    bool        usesHugePages()  const {return hugePages;}
+    bool        setAllocation(Allocation a, bool useHugePages = false);
 
     Node<Data>* createNode(const Data& d);
     Node<Data>* createNode(const Data& d, const Node<Data>* pp);
@@ -28,87 +47,188 @@ public:
     Node<Data>* createNode(Data&& d, const Node<Data>* pl, const Node<Data>* pp, const Node<Data>* pr);
 
     void        destroyNode(Node<Data>* pNode);
+    void        reset();
+    size_t      getLiveNodes()   const {return nLiveNodes;}
+    void        openTree()             {nLiveTrees++;}
+    size_t      closeTree()            {assert(nLiveTrees > 0); return --nLiveTrees;}
+    size_t      getLiveTrees()   const {return nLiveTrees;}
+    size_t      getSlotCount()   const {return vAllocatedNodes.size();}
 
 private:
-    NodeFactory()  {nSequence = 0; vAllocatedNodes.reserve(50);}
-    ~NodeFactory() {destroyAll();}
+    static const size_t arenaChunkSize = 2 * 1024 * 1024; // the size of an x86-64 huge page.
+    static const size_t nodesPerChunk = arenaChunkSize / sizeof(Node<Data>);
 
-    void destroyAll();
-    void checkMemoryAssignement(Node<Data>* const pnew);
-
-    static NodeFactory* pInstance;
+    template<class... Args>
+    Node<Data>* construct(Args&&... args);
+    void* allocateFromArena();
+    void* allocateArenaChunk();
+    void  releaseArenaChunks();
+    void  destroyAll();
+    void  checkMemoryAssignement(Node<Data>* const pnew);
 
+    Allocation                 allocation;
+    bool                       hugePages;
     unsigned int               nSequence;
+    size_t                     nLiveNodes;
+    size_t                     nLiveTrees; // opened by the parsers sharing this factory, and not closed yet.
     std::vector<Node<Data>*>   vAllocatedNodes;
+    std::vector<unsigned int>  vFreeSlots; // released slots of vAllocatedNodes, reused first.
+    std::vector<void*>         vArenaChunks;
+    size_t                     arenaChunk; // index of the chunk being bumped.
+    size_t                     arenaNodes; // nodes already bumped from that chunk.
 };
 
 template<class Data>
-NodeFactory<Data>* NodeFactory<Data>::getOrCreateInstance()
+NodeFactory<Data>::NodeFactory(Allocation a /* = Allocation::heap */, bool useHugePages /* = false */)
+    : allocation(Allocation::heap)
+    , hugePages(false)
+    , nSequence(0)
+    , nLiveNodes(0)
+    , nLiveTrees(0)
+    , arenaChunk(0)
+    , arenaNodes(0)
 {
-    if (pInstance == nullptr)
-        return pInstance = new NodeFactory<Data>;
-    else
-        return pInstance;
+    setAllocation(a, useHugePages); // it stays on heap if arena is not possible for this Data.
+    if (allocation == Allocation::heap)
+        vAllocatedNodes.reserve(50);
 }
 
 template<class Data>
-void NodeFactory<Data>::destroyInstance()
+bool NodeFactory<Data>::setAllocation(Allocation a, bool useHugePages /* = false */)
 {
-    if (pInstance == nullptr)
-        return;
+    if (a == Allocation::arena && !std::is_trivially_destructible<Data>::value)
+        return false; // reset() does not run destructors, so Data must not need them.
 
-    delete pInstance;
-    pInstance = nullptr;
+    if (a == allocation && useHugePages == hugePages)
+        return true;
+
+    destroyAll(); // every node of the former allocation mode is released here.
+    releaseArenaChunks();
+    allocation = a;
+    hugePages = (a == Allocation::arena && useHugePages);
+    return true;
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(const Data& d)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence);
-    checkMemoryAssignement(pNew);
-    return pNew;
+    return construct(d, nSequence);
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(const Data& d, const Node<Data>* pp)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence, pp);
-    checkMemoryAssignement(pNew);
-    return pNew;
+    return construct(d, nSequence, const_cast<Node<Data>*>(pp));
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(const Data& d, const Node<Data>* pl, const Node<Data>* pp, const Node<Data>* pr)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence, pp, pr);
-    checkMemoryAssignement(pNew);
-    return pNew;
+    return construct(d, nSequence, const_cast<Node<Data>*>(pl), const_cast<Node<Data>*>(pp),
+                                   const_cast<Node<Data>*>(pr));
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(Data&& d)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence);
-    checkMemoryAssignement(pNew);
-    return pNew;
+    return construct(std::move(d), nSequence);
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(Data&& d, const Node<Data>* pp)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence, pp);
-    checkMemoryAssignement(pNew);
-    return pNew;
+    return construct(std::move(d), nSequence, const_cast<Node<Data>*>(pp));
 }
 
 template<class Data>
 Node<Data>* NodeFactory<Data>::createNode(Data&& d, const Node<Data>* pl, const Node<Data>* pp, const Node<Data>* pr)
 {
-    Node<Data>* pNew = new Node<Data>(d, nSequence, pp, pr);
+    return construct(std::move(d), nSequence, const_cast<Node<Data>*>(pl), const_cast<Node<Data>*>(pp),
+                                              const_cast<Node<Data>*>(pr));
+}
+
+template<class Data>
+template<class... Args>
+Node<Data>* NodeFactory<Data>::construct(Args&&... args)
+{
+    Node<Data>* pNew = nullptr;
+    if (allocation == Allocation::arena)
+    {
+        void* pStorage = allocateFromArena();
+        if (pStorage != nullptr)
+            pNew = new (pStorage) Node<Data>(std::forward<Args>(args)...);
+    }
+    else
+        pNew = new Node<Data>(std::forward<Args>(args)...);
+
     checkMemoryAssignement(pNew);
     return pNew;
 }
 
+template<class Data>
+void* NodeFactory<Data>::allocateFromArena()
+{
+    if (arenaChunk < vArenaChunks.size() && arenaNodes == nodesPerChunk)
+    {
+        arenaChunk++; // current chunk is exhausted, go on bumping from the next one (if any).
+        arenaNodes = 0;
+    }
+
+    if (arenaChunk == vArenaChunks.size())
+    {
+        void* pChunk = allocateArenaChunk();
+        if (pChunk == nullptr)
+            return nullptr;
+
+        vArenaChunks.push_back(pChunk);
+        arenaNodes = 0;
+    }
+
+    Node<Data>* pFirst = static_cast<Node<Data>*>(vArenaChunks[arenaChunk]);
+    return pFirst + arenaNodes++;
+}
+
+template<class Data>
+void* NodeFactory<Data>::allocateArenaChunk()
+{
+#if defined(__linux__)
+    void* pChunk = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if (hugePages) // explicit huge pages, only if the system has them reserved.
+        pChunk = mmap(nullptr, arenaChunkSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (pChunk == MAP_FAILED)
+    {
+        pChunk = mmap(nullptr, arenaChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pChunk == MAP_FAILED)
+            return nullptr;
+#if defined(MADV_HUGEPAGE)
+        if (hugePages) // fall back to transparent huge pages.
+            madvise(pChunk, arenaChunkSize, MADV_HUGEPAGE);
+#endif
+    }
+    return pChunk;
+#else
+    return ::operator new(arenaChunkSize, std::nothrow);
+#endif
+}
+
+template<class Data>
+void NodeFactory<Data>::releaseArenaChunks()
+{
+    for (void* pChunk : vArenaChunks)
+#if defined(__linux__)
+        munmap(pChunk, arenaChunkSize);
+#else
+        ::operator delete(pChunk);
+#endif
+
+    vArenaChunks.clear();
+    arenaChunk = 0;
+    arenaNodes = 0;
+}
+
 template<class Data>
 void NodeFactory<Data>::checkMemoryAssignement(Node<Data>* const pnew)
 {
@@ -117,10 +237,25 @@ void NodeFactory<Data>::checkMemoryAssignement(Node<Data>* const pnew)
         destroyAll();
         assert(true);
     }
+    else if (allocation == Allocation::arena)
+    {
+        pnew->nSequence = nSequence++; // arena nodes are accounted as a whole, not one by one.
+    }
     else
     {
         pnew->nSequence = nSequence++;
-        vAllocatedNodes.push_back(pnew);
+        nLiveNodes++;
+        if (vFreeSlots.empty())
+        {
+            pnew->nSlot = static_cast<unsigned int>(vAllocatedNodes.size());
+            vAllocatedNodes.push_back(pnew);
+        }
+        else // recycle a released slot, so bookkeeping follows the live nodes, not the created ones.
+        {
+            pnew->nSlot = vFreeSlots.back();
+            vFreeSlots.pop_back();
+            vAllocatedNodes[pnew->nSlot] = pnew;
+        }
     }
 }
 
@@ -128,9 +263,34 @@ template<class Data>
 void NodeFactory<Data>::destroyNode(Node<Data>* pNode)
 {
     if (pNode == nullptr) return;
-    
-    vAllocatedNodes[pNode->nSequence] = nullptr;
+    if (allocation == Allocation::arena) return; // its storage comes back with the next reset().
+
+    unsigned int slot = pNode->nSlot;
+    assert(slot < vAllocatedNodes.size() && vAllocatedNodes[slot] == pNode);
+    vAllocatedNodes[slot] = nullptr;
     delete pNode;
+
+    if (--nLiveNodes == 0) // nothing alive, the whole bookkeeping starts from scratch.
+    {
+        vAllocatedNodes.clear();
+        vFreeSlots.clear();
+    }
+    else
+        vFreeSlots.push_back(slot);
+}
+
+template<class Data>
+void NodeFactory<Data>::reset()
+{
+    assert(nLiveTrees == 0); // no tree of another parser may be released under its feet.
+    if (allocation == Allocation::arena)
+    {
+        arenaChunk = 0; // O(1): chunks are kept, and bumped again from the very beginning.
+        arenaNodes = 0;
+        nSequence = 0;
+    }
+    else
+        destroyAll();
 }
 
 template<class Data>
@@ -144,7 +304,11 @@ void NodeFactory<Data>::destroyAll()
         }
 
     nSequence = 0;
+    nLiveNodes = 0;
+    arenaChunk = 0;
+    arenaNodes = 0;
     vAllocatedNodes.clear();
+    vFreeSlots.clear();
 }
 
 #endif // _NODEFACTORY_H
@@ -10,7 +10,7 @@
 
 enum class OperationId : char
 {
-    first = 0, number = first, e, pi, phi, openParenthesis, closeParenthesis,
+    first = 0, number = first, e, pi, phi, variable, openParenthesis, closeParenthesis,
     firstFunction, sin = firstFunction, cos, tan, sinh, cosh, tanh, exp,
     asin, acos, atan, asinh, acosh, atanh, ln, log10, log2, sqrroot, cubroot,
     lastFunction, gamma = lastFunction,
@@ -0,0 +1,79 @@
+/**
+ * @file PhaseStatistics.h
+ * @brief Cumulative times, counts and latency histograms of the phases an expression goes through.
+ *        Every thread records into its own object, pointed by a thread local pointer which is null
+ *        (and then nothing is measured) unless statistics were requested. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-01
+ */
+
+#ifndef _PHASESTATISTICS_H
+#define _PHASESTATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+class PhaseStatistics
+{
+    static const unsigned subBucketBits = 4; // 16 buckets per power of two, so under 6.25% of error.
+    static const unsigned subBuckets = 1u << subBucketBits;
+    static const unsigned bucketCount = (64 - subBucketBits + 1) * subBuckets;
+
+public:
+    enum class Phase : char
+    {
+        first = 0, tokenizing = first, treeBuilding, evaluation, tabulation, output, total
+    };
+
+    struct Histogram // log-linear buckets of nanoseconds.
+    {
+        uint64_t count;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        uint64_t buckets[bucketCount];
+
+        void     record(uint64_t ns);
+        void     merge(const Histogram& h);
+        uint64_t percentile(double p) const; // upper bound of the bucket holding it, p in [0, 1].
+    };
+
+    PhaseStatistics() {clear();}
+
+    void clear();
+    void record(Phase phase, uint64_t ns) {histograms[static_cast<size_t>(phase)].record(ns);}
+    void merge(const PhaseStatistics& stats);
+    void print(std::ostream& os) const;
+    const Histogram& getHistogram(Phase phase) const {return histograms[static_cast<size_t>(phase)];}
+
+    static uint64_t now() {return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch()).count();}
+
+    // The statistics the instrumentation points of the running thread record into, if any.
+    static PhaseStatistics*& current() {static thread_local PhaseStatistics* pCurrent = nullptr; return pCurrent;}
+
+    static const char* getPhaseName(Phase phase);
+
+private:
+    static unsigned bucketOf(uint64_t ns);
+    static uint64_t bucketUpperBound(unsigned bucket);
+
+    Histogram histograms[static_cast<size_t>(Phase::total)];
+};
+
+// Times its own scope into the current statistics, if there are.
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(PhaseStatistics::Phase ph)
+    : pStats(PhaseStatistics::current()), phase(ph), start(pStats ? PhaseStatistics::now() : 0) {}
+    PhaseTimer(const PhaseTimer&) = delete;
+    ~PhaseTimer() {if (pStats) pStats->record(phase, PhaseStatistics::now() - start);}
+
+private:
+    PhaseStatistics*       pStats;
+    PhaseStatistics::Phase phase;
+    uint64_t               start;
+};
+
+#endif // _PHASESTATISTICS_H
@@ -10,16 +10,15 @@
 #define _TREE_H
 
 #include <cassert>
-#include <functional>
+#include <cstddef>
+#include <vector>
 #include "Node.h"
 
 template<class Data>
 class Tree
 {
-//  using searchPredicate = bool (*)(const Node<Data>*); // former way - function pointer
-    using searchPredicate = std::function<bool(const Node<Data>*)>; // modern way - lambdas
-
 public:
+    Tree()                     {pCurrentNode = pRootNode = nullptr;} // an empty tree, for setRootAndCurrent().
     Tree(Node<Data>* root)     {pCurrentNode = pRootNode = root; root->setParent(nullptr);}
     ~Tree()                    {} // this Tree implementation does not allocate anything.
 
@@ -29,12 +28,14 @@ public:
     void        setRootAndCurrent(Node<Data>* const root) {pCurrentNode = pRootNode = root;}
 
     Node<Data>* skipDownLeft()  {Node<Data>* pRet = pCurrentNode->getLeft();  return pRet ? pCurrentNode = pRet : nullptr;}
-    Node<Data>* skipUp()        {Node<Data>* pRet = pCurrentNode->geParent(); return pRet ? pCurrentNode = pRet : nullptr;}
+    Node<Data>* skipUp()        {Node<Data>* pRet = pCurrentNode->getParent(); return pRet ? pCurrentNode = pRet : nullptr;}
     Node<Data>* skipDownRight() {Node<Data>* pRet = pCurrentNode->getRight(); return pRet ? pCurrentNode = pRet : nullptr;}
 
-    Node<Data>* searchDownLeft(searchPredicate, bool notFoundNoMove = false);
-    Node<Data>* searchUp(searchPredicate, bool notFoundNoMove = false);
-    Node<Data>* searchDownRight(searchPredicate, bool notFoundNoMove = false);
+    // The predicates are any callable bool(const Node<Data>*), a template argument (not a std::function) so that
+    // a lambda is inlined into the search loop instead of being called indirectly on every node.
+    template<class Predicate> Node<Data>* searchDownLeft(Predicate match, bool notFoundNoMove = false);
+    template<class Predicate> Node<Data>* searchUp(Predicate match, bool notFoundNoMove = false);
+    template<class Predicate> Node<Data>* searchDownRight(Predicate match, bool notFoundNoMove = false);
 
     Node<Data>* goTop()         {return pCurrentNode = pRootNode;}
     Node<Data>* goDownLeftMost();
@@ -42,6 +43,48 @@ public:
     Node<Data>* goLeftDownMost();
     Node<Data>* goRightDownMost();
 
+    // Depth first iterator without recursion: the path from the top node down to the current one is an explicit
+    // stack, so the depth of a tree is only bounded by the memory, not by the machine stack. Every node is reached
+    // in three steps: entering it, between its children and leaving it (pre, in and post-order). Every edge is
+    // followed, so a node shared by several parents (a DAG) is reached once from each of them.
+    class Iterator
+    {
+    public:
+        enum class Step : char {enter, between, leave};
+
+        Iterator() : rightFirst(false), fresh(false) {}
+
+        void        start(Node<Data>* pTop, bool rightToLeft = false); // the right children first, if rightToLeft.
+        bool        next(); // to the next step, false at the end. The first call reaches the top node.
+        void        skipChildren()    {vPath.back().skip = true;} // on entering a node, not to walk under it
+                                                                  // (between its children, not the second one).
+
+        Node<Data>* getNode()   const {return vPath.back().pNode;}
+        Node<Data>* getFrom()   const {return vPath.size() > 1 ? vPath[vPath.size() - 2].pNode : nullptr;}
+        Step        getStep()   const {return vPath.back().step;}
+        size_t      getDepth()  const {return vPath.size() - 1;} // 0 for the top node.
+        bool        isSkipped() const {return vPath.back().skip;}
+
+    private:
+        struct Frame
+        {
+            Node<Data>* pNode;
+            Step        step;
+            bool        skip;
+        };
+
+        std::vector<Frame> vPath; // kept allocated from a traversal to the next one.
+        bool               rightFirst;
+        bool               fresh; // started, but the top node not reached yet.
+    };
+
+    // Depth first visits of the subtree under pTop, on an Iterator (no recursion, any depth). The visitor is any
+    // callable, inlined as well, called as visit(pNode, depth) once per node reached (depth 0 for pTop). Only a
+    // pre-order visitor returns something: whether to walk under that node (false skips its children).
+    template<class Visit> static void visitPreOrder(Node<Data>* pTop, Visit visit, bool rightToLeft = false);
+    template<class Visit> static void visitInOrder(Node<Data>* pTop, Visit visit, bool rightToLeft = false);
+    template<class Visit> static void visitPostOrder(Node<Data>* pTop, Visit visit, bool rightToLeft = false);
+
     void makeLeftHalfTree(Node<Data>* const newRoot);
     void makeRightHalfTree(Node<Data>* const newRoot);
     bool deleteCurrentPreserveLeft(bool currentGoUp = false);
@@ -60,11 +103,94 @@ private:
 };
 
 template<class Data>
-Node<Data>* Tree<Data>::searchUp(searchPredicate fp, bool notFoundNoMove /* = false */)
+void Tree<Data>::Iterator::start(Node<Data>* pTop, bool rightToLeft /* = false */)
+{
+    vPath.clear();
+    if (pTop != nullptr)
+        vPath.push_back({pTop, Step::enter, false});
+
+    rightFirst = rightToLeft;
+    fresh = true;
+}
+
+template<class Data>
+bool Tree<Data>::Iterator::next()
+{
+    if (fresh)
+    {
+        fresh = false;
+        return !vPath.empty();
+    }
+
+    if (vPath.empty())
+        return false;
+
+    Frame& frame = vPath.back();
+    if (frame.step == Step::leave) // back to the parent, either between its children or leaving it.
+    {
+        vPath.pop_back();
+        if (vPath.empty())
+            return false;
+
+        Frame& parent = vPath.back();
+        parent.step = (parent.step == Step::enter ? Step::between : Step::leave);
+        return true;
+    }
+
+    Node<Data>* pChild = nullptr; // the first child on entering, the second one between both.
+    if (!frame.skip)
+    {
+        if ((frame.step == Step::enter) != rightFirst)
+            pChild = frame.pNode->getLeft();
+        else
+            pChild = frame.pNode->getRight();
+    }
+
+    if (pChild != nullptr)
+        vPath.push_back({pChild, Step::enter, false});
+    else
+        frame.step = (frame.step == Step::enter ? Step::between : Step::leave);
+
+    return true;
+}
+
+template<class Data>
+template<class Visit>
+void Tree<Data>::visitPreOrder(Node<Data>* pTop, Visit visit, bool rightToLeft /* = false */)
+{
+    Iterator it;
+    for (it.start(pTop, rightToLeft); it.next(); )
+        if (it.getStep() == Iterator::Step::enter && !visit(it.getNode(), it.getDepth()))
+            it.skipChildren();
+}
+
+template<class Data>
+template<class Visit>
+void Tree<Data>::visitInOrder(Node<Data>* pTop, Visit visit, bool rightToLeft /* = false */)
+{
+    Iterator it;
+    for (it.start(pTop, rightToLeft); it.next(); )
+        if (it.getStep() == Iterator::Step::between)
+            visit(it.getNode(), it.getDepth());
+}
+
+template<class Data>
+template<class Visit>
+void Tree<Data>::visitPostOrder(Node<Data>* pTop, Visit visit, bool rightToLeft /* = false */)
+{
+    Iterator it;
+    for (it.start(pTop, rightToLeft); it.next(); )
+        if (it.getStep() == Iterator::Step::leave)
+            visit(it.getNode(), it.getDepth());
+}
+
+template<class Data>
+template<class Predicate>
+Node<Data>* Tree<Data>::searchUp(Predicate match, bool notFoundNoMove /* = false */)
 {
     Node<Data>* pLower = pCurrentNode;
     Node<Data>* pNode = pCurrentNode;
-    while (pNode != nullptr && fp(pNode))
+    while (pNode != nullptr && match(pNode))
     {
         pLower = pNode;
         pNode = pNode->getParent();
@@ -77,11 +203,12 @@ Node<Data>* Tree<Data>::searchUp(searchPredicate fp, bool notFoundNoMove /* = fa
 }
 
 template<class Data>
-Node<Data>* Tree<Data>::searchDownLeft(searchPredicate fp, bool notFoundNoMove /* = false */)
+template<class Predicate>
+Node<Data>* Tree<Data>::searchDownLeft(Predicate match, bool notFoundNoMove /* = false */)
 {
     Node<Data>* pUpper = pCurrentNode;
     Node<Data>* pNode = pCurrentNode;
-    while (pNode != nullptr && fp(pNode))
+    while (pNode != nullptr && match(pNode))
     {
         pUpper = pNode;
         pNode = pNode->getLeft();
@@ -94,11 +221,12 @@ Node<Data>* Tree<Data>::searchDownLeft(searchPredicate fp, bool notFoundNoMove /
 }
 
 template<class Data>
-Node<Data>* Tree<Data>::searchDownRight(searchPredicate fp, bool notFoundNoMove /* = false */)
+template<class Predicate>
+Node<Data>* Tree<Data>::searchDownRight(Predicate match, bool notFoundNoMove /* = false */)
 {
     Node<Data>* pUpper = pCurrentNode;
     Node<Data>* pNode = pCurrentNode;
-    while (pNode != nullptr && fp(pNode))
+    while (pNode != nullptr && match(pNode))
     {
         pUpper = pNode;
         pNode = pNode->getRight();
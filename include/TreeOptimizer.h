@@ -0,0 +1,56 @@
+/**
+ * @file TreeOptimizer.h
+ * @brief Optimization passes over a parsed operand/operator/operand binary tree. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-09
+ */
+
+#ifndef _TREEOPTIMIZER_H
+#define _TREEOPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include "NodeFactory.h"
+#include "OperationItem.h"
+#include "Tree.h"
+
+class TreeOptimizer
+{
+public:
+    TreeOptimizer() = delete;
+    TreeOptimizer(Tree<OperationItem>* ptree, NodeFactory<OperationItem>& factory)
+    : removedNodes(0), pTree(ptree), pFactory(&factory) {}
+
+    size_t foldConstants(); // collapses every subtree without variables into a number, returns the nodes removed.
+    size_t shareSubexpressions(); // merges the identical subtrees (the tree becomes a DAG), returns the nodes removed.
+    size_t getRemovedNodes() const {return removedNodes;} // by all the passes run so far.
+
+private:
+    struct SubtreeKey // a node, once its children are already unique.
+    {
+        OperationId id;
+        uint64_t    valueBits;
+        const Node<OperationItem>* pLeft;
+        const Node<OperationItem>* pRight;
+
+        bool operator == (const SubtreeKey& k) const
+        {return id == k.id && valueBits == k.valueBits && pLeft == k.pLeft && pRight == k.pRight;}
+    };
+
+    struct SubtreeKeyHash
+    {
+        size_t operator () (const SubtreeKey& k) const;
+    };
+
+    using UniqueNodes = std::unordered_map<SubtreeKey, Node<OperationItem>*, SubtreeKeyHash>;
+
+    void foldNode(Node<OperationItem>* pNode);
+    void releaseSubtree(Node<OperationItem>* pTop);
+
+    size_t removedNodes;
+    Tree<OperationItem>*        pTree;
+    NodeFactory<OperationItem>* pFactory; // the one which created the tree nodes.
+};
+
+#endif // _TREEOPTIMIZER_H
@@ -0,0 +1,63 @@
+/**
+ * @file VectorMath.h
+ * @brief Vectorized kernels of the built-in functions, over arrays of doubles, dispatched at run time
+ *        to the widest SIMD instruction set of the CPU. Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-04-05
+ */
+
+#ifndef _VECTORMATH_H
+#define _VECTORMATH_H
+
+#include <cstddef>
+#include "OperationId.h"
+
+// Every function from OperationId::firstFunction to lastFunction, computed without branches nor calls
+// (range reductions and polynomials, the fdlibm and Cephes ones) in loops the compiler vectorizes.
+// Each kernel is built for AVX-512, AVX2 and SSE2 and the running CPU picks one on the first call; all of
+// them give the same bits, since nothing is fused. Within a few ULP of libm (see getMaxUlpError()):
+// not bit for bit like ArithmeticEvaluator. The values outside the domain of a kernel (huge arguments of
+// sin, overflowing exponentials, negative gama, NaN...) are left to ArithmeticEvaluator::operate().
+// Below the full precision, shorter Taylor polynomials (and series of atanh for the logarithms) trade digits
+// for speed; asin, acos, atan, sqrt and gama keep their full precision kernels.
+class VectorMath
+{
+    static const size_t blockSize = 64; // values copied aside, so that the results may overwrite them.
+
+public:
+    using Kernel = void (*)(const double* x, double* y, size_t count);
+
+    enum class Precision : char // relative error of the functions, at most (getMaxError()):
+    {
+        low,    // 1e-4,
+        medium, // 1e-7, about the one of a float,
+        high,   // 1e-11,
+        full,   // a few ULP (getMaxUlpError()).
+        total
+    };
+
+    static bool   isSupported(OperationId id)
+                      {return OperationId::firstFunction <= id && id <= OperationId::lastFunction;}
+    static void   evaluate(OperationId id, const double* x, double* y, size_t count, // y may be x.
+                           Precision precision = Precision::full);
+    static double getMaxUlpError(OperationId id); // measured, against the exact values (a true cube root for curt).
+    static double getMaxError(Precision precision); // relative, of every function.
+    static Precision choosePrecision(double maxError); // the fastest one within a relative error, full at worst.
+    static const char* getInstructionSet(); // the one the kernels run with: "avx512f", "avx2" or "sse2".
+
+private:
+    struct Domain // where a kernel holds, over |x| when it is symmetric.
+    {
+        Kernel kernels[static_cast<size_t>(Precision::total)];
+        bool   symmetric;
+        double low;
+        double high;
+        double maxUlpError;
+    };
+
+    static const Domain domains[static_cast<size_t>(OperationId::lastFunction)
+                                - static_cast<size_t>(OperationId::firstFunction) + 1];
+    static const double maxErrors[static_cast<size_t>(Precision::total)];
+};
+
+#endif // _VECTORMATH_H
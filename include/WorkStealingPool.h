@@ -0,0 +1,59 @@
+/**
+ * @file WorkStealingPool.h
+ * @brief Fixed set of worker threads running indexed batches of independent tasks.
+ *        Every worker owns a range of the batch and steals half of another one when idle.
+ *        Interface file.
+ * @author Guillermo M. Paris
+ * @date 2020-01-12
+ */
+
+#ifndef _WORKSTEALINGPOOL_H
+#define _WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(size_t index, unsigned worker)>;
+
+    explicit WorkStealingPool(unsigned workers);
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    ~WorkStealingPool();
+
+    unsigned getWorkerCount() const {return static_cast<unsigned>(vWorkers.size());}
+    void     start(size_t count, Task task); // tasks 0 .. count-1 begin running, it does not block.
+    void     wait();                         // blocks until every task of the batch has finished.
+
+    static unsigned defaultWorkerCount();
+
+private:
+    struct Range
+    {
+        std::mutex mtx;
+        size_t     begin;
+        size_t     end;
+    };
+
+    void workerLoop(unsigned worker);
+    bool popOwn(unsigned worker, size_t& index);
+    bool steal(unsigned thief, size_t& index);
+
+    std::vector<std::thread> vWorkers;
+    std::vector<Range>       vRanges;
+    Task                     task;
+    std::mutex               mtx;
+    std::condition_variable  cvStart;
+    std::condition_variable  cvDone;
+    unsigned                 generation; // batch number, workers wake up when it changes.
+    std::atomic<size_t>      pending;    // tasks of the current batch not finished yet.
+    bool                     stopping;
+};
+
+#endif // _WORKSTEALINGPOOL_H
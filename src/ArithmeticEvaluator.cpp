@@ -1,5 +1,5 @@
 /**
- * @file ArithmeticEvaluator.h
+ * @file ArithmeticEvaluator.cpp
  * @brief Evaluator of a pure operand/operator/operand binary tree. Implementation file.
  * @author Guillermo M. Paris
  * @date 2019-10-27
@@ -7,22 +7,109 @@
 
 #include <cmath>
 #include <iostream>
+#include <vector>
 #include "ArithmeticEvaluator.h"
+#include "GammaFunction.h"
 #include "OperationItem.h"
+#include "PhaseStatistics.h"
 
-double ArithmeticEvaluator::evaluateNode(const Node<OperationItem>* pNode)
+ArithmeticEvaluator::ArithmeticEvaluator(Tree<OperationItem>* ptree, const double* variables /* = nullptr */)
+    : lastError(0)
+    , pTree(ptree)
+    , pVariables(variables)
+{
+    PhaseTimer timer(PhaseStatistics::Phase::evaluation);
+    result = evaluateNode(ptree->getRoot());
+}
+
+double ArithmeticEvaluator::evaluateNode(const Node<OperationItem>* pNode, unsigned depth /* = 0 */)
 {
     if (pNode == nullptr) return 0.0;
 
-    OperationItem nodeData(pNode->getData());
+    const OperationItem& nodeData = pNode->getData();
+    if (nodeData.id == OperationId::number)
+        return nodeData.value;
+    else if (nodeData.id == OperationId::variable)
+        return pVariables != nullptr ? pVariables[static_cast<size_t>(nodeData.value)] : 0.0;
+
+    if (pNode->isShared())
+    {
+        auto found = sharedResults.find(pNode);
+        if (found != sharedResults.end())
+            return found->second;
+    }
+
+    if (depth == maxRecursionDepth)
+        return evaluateSubtree(pNode); // the deeper levels, without recursion.
 
-    double resultLeft = evaluateNode(pNode->getLeft());
-    double resultRight = evaluateNode(pNode->getRight());
+    double resultLeft = evaluateNode(pNode->getLeft(), depth + 1);
+    double resultRight = evaluateNode(pNode->getRight(), depth + 1);
+    double value = operate(nodeData.id, resultLeft, resultRight);
+    if (pNode->isShared())
+        sharedResults.emplace(pNode, value);
 
-    switch(nodeData.id)
+    return value;
+}
+
+// Post-order, with a Tree iterator: the operands are pushed into vValues on leaving their nodes, and popped by their
+// operator. The subtree of a shared node already computed is not walked again.
+double ArithmeticEvaluator::evaluateSubtree(const Node<OperationItem>* pTop)
+{
+    Tree<OperationItem>::Iterator it;
+    std::vector<double> vValues;
+    for (it.start(const_cast<Node<OperationItem>*>(pTop)); it.next(); )
+    {
+        const Node<OperationItem>* pNode = it.getNode();
+        const OperationItem& nodeData = pNode->getData();
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter)
+        {
+            if (nodeData.id == OperationId::number)
+                vValues.push_back(nodeData.value);
+            else if (nodeData.id == OperationId::variable)
+                vValues.push_back(pVariables != nullptr ? pVariables[static_cast<size_t>(nodeData.value)] : 0.0);
+            else if (pNode->isShared())
+            {
+                auto found = sharedResults.find(pNode);
+                if (found == sharedResults.end())
+                    continue;
+
+                vValues.push_back(found->second);
+            }
+            else
+                continue;
+
+            it.skipChildren(); // a value already.
+        }
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::leave && !it.isSkipped())
+        {
+            double resultRight = 0.0; // of a missing operand.
+            double resultLeft = 0.0;
+            if (pNode->getRight() != nullptr)
+            {
+                resultRight = vValues.back();
+                vValues.pop_back();
+            }
+            if (pNode->getLeft() != nullptr)
+            {
+                resultLeft = vValues.back();
+                vValues.pop_back();
+            }
+
+            double value = operate(nodeData.id, resultLeft, resultRight);
+            if (pNode->isShared())
+                sharedResults.emplace(pNode, value);
+
+            vValues.push_back(value);
+        }
+    }
+
+    return vValues.back();
+}
+
+double ArithmeticEvaluator::operate(OperationId id, double resultLeft, double resultRight)
+{
+    switch(id)
     {
-    case OperationId::number:
-        return nodeData.value;
 
     case OperationId::sin:
         return sin(resultRight);
@@ -87,10 +174,10 @@ double ArithmeticEvaluator::evaluateNode(const Node<OperationItem>* pNode)
         }
 
     case OperationId::gamma:
-        return tgamma(resultRight);
+        return GammaFunction::gamma(resultRight);
 
     case OperationId::factorial:
-        return factorial(resultLeft);
+        return GammaFunction::factorial(resultLeft);
 
     case OperationId::power:
         return pow(resultLeft, resultRight);
@@ -123,15 +210,3 @@ double ArithmeticEvaluator::evaluateNode(const Node<OperationItem>* pNode)
         return 0.0;
     }
 }
-
-double ArithmeticEvaluator::factorial(double n)
-{
-	long long l, retVal = 1, m = static_cast<long>(n);
-	for(l = 2; l <= m; l++)
-        retVal *= l;
-
-	return static_cast<double>(retVal);
-}
-
-
-
@@ -0,0 +1,133 @@
+/**
+ * @file CompactTree.cpp
+ * @brief Operand/operator/operand binary tree stored as a structure of arrays: the nodes in post-order,
+ *        their children as 32-bit indexes. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-15
+ */
+
+#include <unordered_map>
+#include "ArithmeticEvaluator.h"
+#include "CompactTree.h"
+
+// A post-order walk: every node is appended on leaving it, once its children (whose indexes are
+// on vIndexes) are already there. A shared node is appended the first time, and then just referred to.
+bool CompactTree::build(const Tree<OperationItem>* pTree)
+{
+    vIds.clear();
+    vValues.clear();
+    vLeft.clear();
+    vRight.clear();
+    if (pTree == nullptr || pTree->getRoot() == nullptr)
+        return false;
+
+    std::vector<uint32_t> vIndexes;
+    std::unordered_map<const Node<OperationItem>*, uint32_t> sharedIndexes;
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTree->getRoot()); it.next(); )
+    {
+        const Node<OperationItem>* pNode = it.getNode();
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter && pNode->isShared())
+        {
+            auto found = sharedIndexes.find(pNode);
+            if (found != sharedIndexes.end())
+            {
+                vIndexes.push_back(found->second);
+                it.skipChildren();
+            }
+        }
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::leave && !it.isSkipped())
+        {
+            uint32_t right = noChild;
+            uint32_t left = noChild;
+            if (pNode->getRight() != nullptr)
+            {
+                right = vIndexes.back();
+                vIndexes.pop_back();
+            }
+            if (pNode->getLeft() != nullptr)
+            {
+                left = vIndexes.back();
+                vIndexes.pop_back();
+            }
+
+            uint32_t index = static_cast<uint32_t>(vIds.size());
+            vIds.push_back(pNode->getData().id);
+            vValues.push_back(pNode->getData().value);
+            vLeft.push_back(left);
+            vRight.push_back(right);
+            vIndexes.push_back(index);
+            if (pNode->isShared())
+                sharedIndexes.emplace(pNode, index);
+        }
+    }
+
+    return true;
+}
+
+double CompactTree::evaluate(const double* variables /* = nullptr */) const
+{
+    if (vIds.empty())
+        return 0.0;
+
+    if (vIds.size() <= localResultsSize)
+    {
+        double results[localResultsSize];
+        return run(results, variables);
+    }
+
+    std::vector<double> results(vIds.size());
+    return run(results.data(), variables);
+}
+
+// One forward pass: the children of a node are computed before it, so results[] holds their values.
+// The same operations as ArithmeticEvaluator, for the same results bit for bit.
+double CompactTree::run(double* results, const double* variables) const
+{
+    const OperationId* ids = vIds.data();
+    const double* values = vValues.data();
+    const uint32_t* lefts = vLeft.data();
+    const uint32_t* rights = vRight.data();
+    size_t size = vIds.size();
+    for (size_t i = 0; i < size; i++)
+    {
+        OperationId id = ids[i];
+        if (id == OperationId::number)
+        {
+            results[i] = values[i];
+            continue;
+        }
+        else if (id == OperationId::variable)
+        {
+            results[i] = (variables != nullptr ? variables[static_cast<size_t>(values[i])] : 0.0);
+            continue;
+        }
+
+        double left = (lefts[i] != noChild ? results[lefts[i]] : 0.0); // a missing operand is 0.
+        double right = (rights[i] != noChild ? results[rights[i]] : 0.0);
+        switch (id)
+        {
+        case OperationId::plus:
+            results[i] = left + right;
+            break;
+
+        case OperationId::minus:
+            results[i] = left - right;
+            break;
+
+        case OperationId::multiply:
+            results[i] = left * right;
+            break;
+
+        case OperationId::divide:
+            results[i] = left / right;
+            break;
+
+        default:
+            results[i] = ArithmeticEvaluator::operate(id, left, right);
+            break;
+        }
+    }
+
+    return results[size - 1];
+}
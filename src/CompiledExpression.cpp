@@ -0,0 +1,359 @@
+/**
+ * @file CompiledExpression.cpp
+ * @brief Operand/operator/operand binary tree compiled into a flat postfix program,
+ *        and the stack machine running it. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-02
+ */
+
+#include <cmath>
+#include <cstdint>
+#include "ArithmeticEvaluator.h"
+#include "CompiledExpression.h"
+#include "OperationItem.h"
+#include "VectorMath.h"
+
+bool CompiledExpression::compile(const Tree<OperationItem>* pTree)
+{
+    vCode.clear();
+    vConstants.clear();
+    stackDepth = 0;
+    variableCount = 0;
+    sharedCount = 0;
+    if (pTree == nullptr)
+        return false;
+
+    bool compiled = compileSubtree(pTree->getRoot());
+    sharedIndexes.clear();
+    if (!compiled)
+    {
+        vCode.clear();
+        vConstants.clear();
+        stackDepth = variableCount = sharedCount = 0;
+        return false;
+    }
+
+    return true;
+}
+
+// The operands an operator really uses, as ArithmeticEvaluator ignores the others: the left one of functions
+// and unary + -, and the right one of the factorial. None, for a parenthesis or not an operation.
+static void usedOperands(OperationId id, bool& left, bool& right)
+{
+    bool binary = (OperationId::power <= id && id <= OperationId::reminder)
+                  || id == OperationId::plus || id == OperationId::minus;
+    left = binary || id == OperationId::factorial;
+    right = binary || (OperationId::firstFunction <= id && id <= OperationId::lastFunction)
+            || id == OperationId::positive || id == OperationId::negative;
+}
+
+// Postfix emission, on a post-order Tree iterator walk (any depth). Just the used operands are compiled.
+// vDepths holds, for every operator on the path, the stack depth where the operand being walked lands.
+bool CompiledExpression::compileSubtree(const Node<OperationItem>* pTop)
+{
+    if (pTop == nullptr)
+    {
+        emitConstant(0.0, 0); // a missing operand evaluates as 0, like in "1 + ".
+        return true;
+    }
+
+    const size_t ignored = SIZE_MAX; // an operand not used, not compiled.
+    std::vector<size_t> vDepths;
+    Tree<OperationItem>::Iterator it;
+    for (it.start(const_cast<Node<OperationItem>*>(pTop)); it.next(); )
+    {
+        if (it.isSkipped())
+            continue;
+
+        const Node<OperationItem>* pNode = it.getNode();
+        const OperationItem& item = pNode->getData();
+        OperationId id = item.id;
+        size_t level = it.getDepth();
+        size_t depth = (level > 0 ? vDepths[level - 1] : 0);
+        bool left, right;
+        usedOperands(id, left, right);
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter)
+        {
+            if (depth == ignored)
+            {
+                it.skipChildren(); // not used by the operator above.
+                continue;
+            }
+
+            if (id == OperationId::number)
+                emitConstant(item.value, depth);
+            else if (id == OperationId::variable)
+            {
+                uint32_t index = static_cast<uint32_t>(item.value);
+                emit(id, index, depth);
+                if (index + 1 > variableCount)
+                    variableCount = index + 1;
+            }
+            else if (pNode->isShared() && sharedIndexes.count(pNode) > 0) // a DAG node, computed the first time
+                emit(loadShared, sharedIndexes[pNode], depth);           // and loaded the next ones.
+            else if (!left && !right)
+                return false; // parenthesis or not an operation.
+            else
+            {
+                vDepths.resize(level + 1);
+                vDepths[level] = (left ? depth : ignored);
+                continue;
+            }
+
+            it.skipChildren(); // a value already.
+        }
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::between)
+        {
+            if (left && pNode->getLeft() == nullptr)
+                emitConstant(0.0, depth);
+
+            vDepths[level] = (right ? (left ? depth + 1 : depth) : ignored);
+        }
+        else // leave.
+        {
+            if (right && pNode->getRight() == nullptr)
+                emitConstant(0.0, vDepths[level]);
+
+            emit(id, 0, depth);
+            if (pNode->isShared())
+            {
+                uint32_t index = static_cast<uint32_t>(sharedCount++);
+                sharedIndexes.emplace(pNode, index);
+                emit(storeShared, index, depth); // a copy of the result, which stays on the stack.
+            }
+        }
+    }
+
+    return true;
+}
+
+void CompiledExpression::emitConstant(double value, size_t depth)
+{
+    emit(OperationId::number, static_cast<uint32_t>(vConstants.size()), depth);
+    vConstants.push_back(value);
+}
+
+void CompiledExpression::emit(OperationId id, uint32_t operand, size_t depth)
+{
+    vCode.push_back({id, operand});
+    if (depth + 1 > stackDepth)
+        stackDepth = depth + 1; // the instruction result lands on depth.
+}
+
+double CompiledExpression::evaluate(const double* variables /* = nullptr */) const
+{
+    if (vCode.empty())
+        return 0.0;
+
+    if (stackDepth + sharedCount <= localStackSize)
+    {
+        double stack[localStackSize];
+        return run(stack, variables);
+    }
+
+    std::vector<double> stack(stackDepth + sharedCount);
+    return run(stack.data(), variables);
+}
+
+// variableArrays[v] holds count values of the variable v. The program runs once per batch of
+// batchLanes points, every instruction being a short loop the compiler turns into SIMD code.
+// With vectorMath the functions are too: by the kernels of VectorMath at the given precision, instead of libm
+// one value at a time.
+void CompiledExpression::evaluate(const double* const* variableArrays, double* results, size_t count,
+                                  bool vectorMath /* = false */,
+                                  VectorMath::Precision precision /* = VectorMath::Precision::full */) const
+{
+    if (vCode.empty())
+    {
+        for (size_t i = 0; i < count; i++)
+            results[i] = 0.0;
+        return;
+    }
+
+    std::vector<double> heapStack;
+    double localStack[localBatchDepth * batchLanes];
+    double* stack = localStack;
+    if (stackDepth + sharedCount > localBatchDepth)
+    {
+        heapStack.resize((stackDepth + sharedCount) * batchLanes);
+        stack = heapStack.data();
+    }
+
+    for (size_t first = 0; first < count; first += batchLanes)
+    {
+        size_t lanes = (count - first < batchLanes ? count - first : batchLanes);
+        runBatch(stack, variableArrays, first, lanes, results, vectorMath, precision);
+    }
+}
+
+// The stack machine: sp points to the top operand, binary operators take sp[-1] (left) and sp[0] (right).
+double CompiledExpression::run(double* stack, const double* variables) const
+{
+    double* sp = stack - 1;
+    double* shared = stack + stackDepth;
+    const double* constants = vConstants.data();
+    for (const Instruction& instr : vCode)
+    {
+        switch (instr.id)
+        {
+        case OperationId::number:
+            *++sp = constants[instr.operand];
+            break;
+
+        case storeShared:
+            shared[instr.operand] = *sp;
+            break;
+
+        case loadShared:
+            *++sp = shared[instr.operand];
+            break;
+
+        case OperationId::variable:
+            *++sp = (variables != nullptr ? variables[instr.operand] : 0.0);
+            break;
+
+        case OperationId::multiply:
+            sp[-1] = sp[-1] * sp[0];
+            --sp;
+            break;
+
+        case OperationId::divide:
+            sp[-1] = sp[-1] / sp[0];
+            --sp;
+            break;
+
+        case OperationId::plus:
+            sp[-1] = sp[-1] + sp[0];
+            --sp;
+            break;
+
+        case OperationId::minus:
+            sp[-1] = sp[-1] - sp[0];
+            --sp;
+            break;
+
+        case OperationId::negative:
+            *sp = -*sp;
+            break;
+
+        case OperationId::power:
+        case OperationId::reminder:
+            sp[-1] = ArithmeticEvaluator::operate(instr.id, sp[-1], sp[0]);
+            --sp;
+            break;
+
+        case OperationId::factorial: // unary, over its left operand.
+            *sp = ArithmeticEvaluator::operate(instr.id, *sp, 0.0);
+            break;
+
+        default: // functions and unary +, over their right operand.
+            *sp = ArithmeticEvaluator::operate(instr.id, 0.0, *sp);
+            break;
+        }
+    }
+
+    return *sp;
+}
+
+// The same stack machine, but every stack slot holds batchLanes values (one per point).
+void CompiledExpression::runBatch(double* stack, const double* const* variableArrays, size_t first, size_t lanes,
+                                  double* results, bool vectorMath, VectorMath::Precision precision) const
+{
+    const size_t L = batchLanes;
+    double* sp = stack - L;
+    double* shared = stack + stackDepth * L;
+    const double* constants = vConstants.data();
+    for (const Instruction& instr : vCode)
+    {
+        double* left = sp - L;
+        switch (instr.id)
+        {
+        case OperationId::number:
+        {
+            sp += L;
+            double value = constants[instr.operand];
+            for (size_t k = 0; k < lanes; k++)
+                sp[k] = value;
+            break;
+        }
+
+        case storeShared:
+        {
+            double* values = shared + instr.operand * L;
+            for (size_t k = 0; k < lanes; k++)
+                values[k] = sp[k];
+            break;
+        }
+
+        case loadShared:
+        {
+            sp += L;
+            const double* values = shared + instr.operand * L;
+            for (size_t k = 0; k < lanes; k++)
+                sp[k] = values[k];
+            break;
+        }
+
+        case OperationId::variable:
+        {
+            sp += L;
+            const double* values = variableArrays[instr.operand] + first;
+            for (size_t k = 0; k < lanes; k++)
+                sp[k] = values[k];
+            break;
+        }
+
+        case OperationId::multiply:
+            for (size_t k = 0; k < lanes; k++)
+                left[k] = left[k] * sp[k];
+            sp = left;
+            break;
+
+        case OperationId::divide:
+            for (size_t k = 0; k < lanes; k++)
+                left[k] = left[k] / sp[k];
+            sp = left;
+            break;
+
+        case OperationId::plus:
+            for (size_t k = 0; k < lanes; k++)
+                left[k] = left[k] + sp[k];
+            sp = left;
+            break;
+
+        case OperationId::minus:
+            for (size_t k = 0; k < lanes; k++)
+                left[k] = left[k] - sp[k];
+            sp = left;
+            break;
+
+        case OperationId::negative:
+            for (size_t k = 0; k < lanes; k++)
+                sp[k] = -sp[k];
+            break;
+
+        case OperationId::power:
+        case OperationId::reminder:
+            for (size_t k = 0; k < lanes; k++)
+                left[k] = ArithmeticEvaluator::operate(instr.id, left[k], sp[k]);
+            sp = left;
+            break;
+
+        case OperationId::factorial: // unary, over its left operand.
+            for (size_t k = 0; k < lanes; k++)
+                sp[k] = ArithmeticEvaluator::operate(instr.id, sp[k], 0.0);
+            break;
+
+        default: // functions and unary +, over their right operand.
+            if (vectorMath && VectorMath::isSupported(instr.id))
+                VectorMath::evaluate(instr.id, sp, sp, lanes, precision);
+            else
+                for (size_t k = 0; k < lanes; k++)
+                    sp[k] = ArithmeticEvaluator::operate(instr.id, 0.0, sp[k]);
+            break;
+        }
+    }
+
+    for (size_t k = 0; k < lanes; k++)
+        results[first + k] = sp[k];
+}
@@ -0,0 +1,178 @@
+/**
+ * @file ExpressionCache.cpp
+ * @brief Thread safe LRU cache of evaluated (and optionally compiled) expressions, keyed by
+ *        a normalized form of the expression. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-16
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "ExpressionCache.h"
+#include "OperationItem.h"
+
+ExpressionCache::ExpressionCache(size_t cap, size_t shards /* = defaultShards */)
+    : capacity(cap > 0 ? cap : 1)
+    , vShards(shards > 0 ? (shards < capacity ? shards : capacity) : 1) // at least one entry per shard.
+    , hits(0)
+    , misses(0)
+    , evictions(0)
+{
+    size_t n = vShards.size();
+    for (size_t i = 0; i < n; i++) // the remainder spread over the first shards, so the total is capacity.
+        vShards[i].capacity = capacity / n + (i < capacity % n ? 1 : 0);
+}
+
+bool ExpressionCache::find(const std::string& key, Entry& entry, bool countMiss /* = true */)
+{
+    Shard& shard = shardOf(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            shard.lruItems.splice(shard.lruItems.begin(), shard.lruItems, found->second); // now the most recent.
+            entry = found->second->second;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    if (countMiss)
+        misses.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+}
+
+void ExpressionCache::insert(const std::string& key, const Entry& entry)
+{
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) // inserted by another thread meanwhile, just refreshed.
+    {
+        found->second->second = entry;
+        shard.lruItems.splice(shard.lruItems.begin(), shard.lruItems, found->second);
+        return;
+    }
+
+    if (shard.lruItems.size() >= shard.capacity)
+    {
+        shard.index.erase(shard.lruItems.back().first);
+        shard.lruItems.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.lruItems.emplace_front(key, entry);
+    shard.index.emplace(key, shard.lruItems.begin());
+}
+
+ExpressionCache::Statistics ExpressionCache::getStatistics() const
+{
+    Statistics stats = {hits.load(), misses.load(), evictions.load(), 0};
+    for (const Shard& shard : vShards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        stats.entries += shard.lruItems.size();
+    }
+
+    return stats;
+}
+
+// White spaces end the item being read ("1 2" is not "12", "si n" is no function), so a run of them is kept as
+// a single space. Only the ones at both ends of the expression are dropped.
+std::string ExpressionCache::normalize(const char* pcExpr, size_t length)
+{
+    std::string key("T"); // text key.
+    key.reserve(length + 1);
+    bool pendingSpace = false;
+    for (size_t i = 0; i < length && pcExpr[i] != '\0'; i++)
+    {
+        char c = pcExpr[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') // the white spaces skipped by the parser.
+        {
+            pendingSpace = (key.size() > 1);
+            continue;
+        }
+
+        if (pendingSpace)
+            key += ' ';
+
+        key += c;
+        pendingSpace = false;
+    }
+
+    return key;
+}
+
+// Prefix form of the tree, with the operands of + and * in a fixed order. Just swapped, not reassociated:
+// a + b and b + a are the very same double, but (a + b) + c and a + (b + c) may differ.
+// Built in a single string by a Tree iterator walk, whatever the depth: the operands of a node are appended
+// between its "#id(" and ")", and those of + and * rotated into place on leaving it if they are out of order.
+std::string ExpressionCache::canonicalForm(const Tree<OperationItem>* pTree)
+{
+    if (pTree == nullptr)
+        return std::string();
+
+    std::string key("C"); // canonical key.
+    if (pTree->getRoot() == nullptr)
+        return key + '0';
+
+    std::vector<size_t> vStarts; // of the left and right operands of the nodes on the path.
+    char buffer[32];
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTree->getRoot()); it.next(); )
+    {
+        const Node<OperationItem>* pNode = it.getNode();
+        const OperationItem& item = pNode->getData();
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter)
+        {
+            if (item.id == OperationId::number)
+                snprintf(buffer, sizeof(buffer), "%.17g", item.value); // enough digits to get the same double back.
+            else if (item.id == OperationId::variable)
+                snprintf(buffer, sizeof(buffer), "$%d", static_cast<int>(item.value));
+            else
+            {
+                snprintf(buffer, sizeof(buffer), "#%d(", static_cast<int>(item.id)); // ids, as some symbols are shared.
+                key += buffer;
+                vStarts.push_back(key.size());
+                continue;
+            }
+
+            key += buffer;
+            it.skipChildren(); // a leaf.
+        }
+        else if (it.isSkipped())
+            continue;
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::between)
+        {
+            if (pNode->getLeft() == nullptr)
+                key += '0'; // a missing operand evaluates as 0.
+
+            key += ',';
+            vStarts.push_back(key.size());
+        }
+        else // leave.
+        {
+            if (pNode->getRight() == nullptr)
+                key += '0';
+
+            size_t right = vStarts.back();
+            vStarts.pop_back();
+            size_t left = vStarts.back();
+            vStarts.pop_back();
+            size_t leftLength = right - 1 - left;
+            size_t rightLength = key.size() - right;
+            if ((item.id == OperationId::plus || item.id == OperationId::multiply)
+                && key.compare(right, rightLength, key, left, leftLength) < 0)
+            {
+                std::rotate(key.begin() + left, key.begin() + right, key.end()); // "L,R" to "RL,"
+                std::rotate(key.begin() + left + rightLength, key.end() - 1, key.end()); // and to "R,L".
+            }
+
+            key += ')';
+        }
+    }
+
+    return key;
+}
@@ -10,33 +10,63 @@
 #include <cmath>
 #include <iostream>
 #include <string>
+#include "DecimalConverter.h"
 #include "ExpressionParser.h"
 #include "NodeFactory.h"
 #include "OperationItem.h"
+#include "PhaseStatistics.h"
 
-union uintchar4
+// Function names packed into 4 bytes, the first char into the lowest one (zero padded when shorter).
+static constexpr uint32_t packName(const char* name)
 {
-    uintchar4(const char* sym);
+    uint32_t key = 0;
+    for (unsigned i = 0; i < OperationItem::symbolLength && name[i] != '\0'; i++)
+        key |= static_cast<uint32_t>(static_cast<unsigned char>(name[i])) << (8 * i);
 
-    uint32_t number;
-    char symbol[4];
+    return key;
+}
+
+// Perfect hash of the function names, generated at compile time from OperationItem::operandTable:
+// a multiplicative hash, whose multiplier is the first one found giving every name its own slot.
+struct FunctionSlot
+{
+    uint32_t    key; // 0 for an empty slot.
+    OperationId id;
+};
+
+struct FunctionHash
+{
+    static const unsigned bits = 6; // 64 slots, for the 19 functions.
+
+    uint32_t     multiplier;
+    FunctionSlot slots[1u << bits];
+
+    constexpr unsigned slotOf(uint32_t key) const {return (key * multiplier) >> (32 - bits);}
 };
 
-uintchar4::uintchar4(const char* sym)
+static constexpr FunctionHash makeFunctionHash()
 {
-    unsigned n = 0;
-    if (sym)
+    for (uint32_t multiplier = 0x9E3779B1u; ; multiplier += 2) // odd ones, from the golden ratio.
     {
-        for (; n < 4; n++)
-            if ((symbol[n] = sym[n]) == 0)
-                break;
-        n++;
-    }
+        FunctionHash hash = {multiplier, {}};
+        bool collision = false;
+        unsigned first = static_cast<unsigned>(OperationId::firstFunction);
+        unsigned last = static_cast<unsigned>(OperationId::lastFunction);
+        for (unsigned u = first; u <= last && !collision; u++)
+        {
+            uint32_t key = packName(OperationItem::operandTable[u].symbol);
+            FunctionSlot& slot = hash.slots[hash.slotOf(key)];
+            collision = (slot.key != 0);
+            slot = {key, OperationItem::operandTable[u].id};
+        }
 
-    for (; n < 4; n++)
-        symbol[n] = 0;
+        if (!collision)
+            return hash;
+    }
 }
 
+static constexpr FunctionHash functionHash = makeFunctionHash();
+
 static void debugItem(const char* msg, const OperationItem& item, bool noCR = false)
 {
     bool isNumber = (item.id == OperationId::number ? true : false);
@@ -102,102 +132,94 @@ const char* ExpressionParser::getErrorMessage(int index)
 
 ExpressionParser::ExpressionParser(const char* pcExpression, Verbosity v)
     : verbosity(v)
+    , engine(Engine::treeClimbing)
     , lastError(Error::success)
     , cLastParsed(0)
     , lastIndex(0)
     , szExpression(pcExpression)
+    , pcEnd(nullptr)
+    , pVariableNames(nullptr)
+    , pFactory(new NodeFactory<OperationItem>)
+    , ownFactory(true)
     , pTree(nullptr)
 {
     parseExpression(pcExpression);
 }
 
-std::ostream& ExpressionParser::operator << (std::ostream& os)
+ExpressionParser::ExpressionParser(const char* pcExpression, Verbosity v, NodeFactory<OperationItem>& factory,
+                                   const VariableNames* pVariables /* = nullptr */,
+                                   Engine e /* = Engine::treeClimbing */)
+    : verbosity(v)
+    , engine(e)
+    , lastError(Error::success)
+    , cLastParsed(0)
+    , lastIndex(0)
+    , szExpression(pcExpression)
+    , pcEnd(nullptr)
+    , pVariableNames(pVariables)
+    , pFactory(&factory)
+    , ownFactory(false)
+    , pTree(nullptr)
 {
-    printTree(os);
-    return os;
+    parseExpression(pcExpression);
 }
 
-void  ExpressionParser::populateFunctionNamesTable()
+ExpressionParser::ExpressionParser(const char* pcExpression, size_t length, Verbosity v,
+                                   NodeFactory<OperationItem>& factory,
+                                   const VariableNames* pVariables /* = nullptr */,
+                                   Engine e /* = Engine::treeClimbing */)
+    : verbosity(v)
+    , engine(e)
+    , lastError(Error::success)
+    , cLastParsed(0)
+    , lastIndex(0)
+    , szExpression(pcExpression)
+    , pcEnd(pcExpression + length)
+    , pVariableNames(pVariables)
+    , pFactory(&factory)
+    , ownFactory(false)
+    , pTree(nullptr)
 {
-    unsigned int min = static_cast<unsigned int>(OperationId::firstFunction);
-    unsigned int max = static_cast<unsigned int>(OperationId::lastFunction);
-    for (unsigned int u = min; u <= max; u++)
-    {
-        const OperationItem & opItem = OperationItem::operandTable[u];
-        uintchar4 uKey(opItem.symbol);
-        functionNames.insert(std::make_pair(uKey.number , opItem.id));
-    }
+    parseExpression(pcExpression);
 }
 
-const char*  ExpressionParser::expressionSanityCheck(const char* pcExpression)
+ExpressionParser::~ExpressionParser()
 {
-    if (pcExpression == nullptr || *pcExpression == '\0')
-    {
-        lastError = Error::voidExpression; // no expression to parse.
-        return nullptr;
-    }
-
-    bool whiteChar = true;
-    char c = 0;
-    int l = 0;
-    int trimIndex = 0;
-    int parenthesisBalance = 0;
-    while ((c = pcExpression[l++]) != 0)
-    {
-        if (c == ' ' ||  c == '\t' || c == '\r' || c == '\n')
-            continue;
-
-        if (whiteChar)
-        {
-            trimIndex = l - 1;
-            whiteChar = false;
-        }
+    if (pTree != nullptr)
+        destroyTree();
 
-        if (c == '(')
-            parenthesisBalance++;
-        else if (c == ')')
-            parenthesisBalance--;
-    }
-
-    if (whiteChar)
-    {
-        lastError = Error::voidExpression; // void input expression
-        cLastParsed = ' ';
-        lastIndex = l - 1;
-        return nullptr;
-    }
-    else if (parenthesisBalance != 0)
-    {
-        lastError = Error::noMatchingParenthesis; // no matching parenthesis found
-        cLastParsed = ' ';
-        lastIndex = l - 1;
-        return nullptr;
-    }
-    else if (trimIndex > 0)
-    {
-        pcExpression += trimIndex; // skip all the "white" leading chars
-    }
+    if (ownFactory)
+        delete pFactory;
+}
 
-    return pcExpression;
+std::ostream& ExpressionParser::operator << (std::ostream& os)
+{
+    printTree(os);
+    return os;
 }
 
+// The digits are accumulated straight from the expression, and converted once by DecimalConverter
+// (correctly rounded, neither allocations nor locales involved).
 bool  ExpressionParser::parseNumberForward(double& returnValue, const char* & currentParsingLine)
 {
     bool decimalPoint = false;
     bool engNotation = false;
-    char c = *currentParsingLine;
+    bool negativeExponent = false;
+    char c = charAt(currentParsingLine);
     int digitCount = 0;
-    std::string sNumber;
+    uint64_t digits = 0;      // every significant digit, fits as they are less than maxNumberOfDigits.
+    int64_t  exponent = 0;    // returnValue = digits * 10^exponent
+    int64_t  engExponent = 0; // the one written after 'E'.
 
     do
     {
         if (c == '.')
         {
-            if (decimalPoint)
+            if (decimalPoint || engNotation)
             {
-                lastError = Error::incorrectDecimalPoint; // error, two decimal points.
+                lastError = Error::incorrectDecimalPoint; // error, two decimal points, or one in the exponent.
                 cLastParsed = c;
-                return false; // error, two decimal points.
+                return false;
             }
 
             decimalPoint = true;
@@ -205,35 +227,38 @@ bool  ExpressionParser::parseNumberForward(double& returnValue, const char* & cu
         else if (c == 'e' || c == 'E')
         {
             if (engNotation)
-            {                        // Two exponent marks! Then second 'E' was not an engineering notation mark.
-               --currentParsingLine; // give back 'E' to the curent line. Not processed here.
-                break;
-            }
-
-            engNotation = true;
+                break; // Two exponent marks! Then second 'E' is left to the current line. Not processed here.
 
-            char cNext = *(1 + currentParsingLine);
+            char cNext = charAt(1 + currentParsingLine);
             if (('0' <= cNext && cNext <= '9') || cNext == '+' || cNext == '-')
             {
-                sNumber.append(1, c);
-                sNumber.append(1, cNext);
+                engNotation = true;
+                negativeExponent = (cNext == '-');
+                if ('0' <= cNext && cNext <= '9')
+                    engExponent = cNext - '0';
+
                 currentParsingLine += 2;
                 digitCount += 2;
-                c = *currentParsingLine;
+                c = charAt(currentParsingLine);
                 continue;
             }
-            else // 'E' was not an engineering notation mark.
-            {
-                --currentParsingLine; // give back 'E' to the curent line. Not processed here.
+            else // 'E' was not an engineering notation mark, so it is left to the current line.
                 break;
-            }
         }
-
-        sNumber.append(1, c);
-        if ('0' <= c && c <= '9')
+        else if (engNotation)
+        {
+            engExponent = engExponent * 10 + (c - '0'); // less than maxNumberOfDigits digits, no overflow.
+            digitCount++;
+        }
+        else
+        {
+            digits = digits * 10 + static_cast<unsigned>(c - '0');
+            if (decimalPoint)
+                exponent--;
             digitCount++;
+        }
 
-        c = *(++currentParsingLine);
+        c = charAt(++currentParsingLine);
     }
     while ((('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E') && digitCount < maxNumberOfDigits);
 
@@ -244,22 +269,16 @@ bool  ExpressionParser::parseNumberForward(double& returnValue, const char* & cu
         return false;
     }
 
-    if (sNumber.back() == '.') // if last numeric character was '.'
-    {
-        sNumber.append(1, '0'); // avoid ending in '.' ,  "nnn.0" is better
-    }
-
-    returnValue = std::stold(sNumber);
+    exponent += (negativeExponent ? -engExponent : engExponent);
+    returnValue = DecimalConverter::toDouble(digits, exponent);
     return true;
 }
 
 bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const char* & currentLine)
 {
-    using functionNamesIter = std::unordered_map<uint32_t, OperationId>::iterator;
-
     char name[6] = {0}; // word to be search must be wholy clear.
-    name[0] = *currentLine; // caller function assures this is a valid letter char
-    name[1] = *(1 + currentLine);
+    name[0] = charAt(currentLine); // caller function assures this is a valid letter char
+    name[1] = charAt(1 + currentLine);
 
     if ((name[1] < 'A' || name[1] > 'Z') && (name[1] < 'a' || name[1] > 'z'))
     {
@@ -276,7 +295,7 @@ bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const cha
         return false; // not a letter char
     }
 
-    name[2] = *(2 + currentLine);
+    name[2] = charAt(2 + currentLine);
     if ((name[2] < 'A' || name[2] > 'Z') && (name[2] < 'a' || name[2] > 'z') && name[2] != '(')
     {
         if (name[0] == 'p' && name[1] == 'i' ) // just two letters => Pitágoras number
@@ -297,7 +316,7 @@ bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const cha
     if (name[2] != '(')
     {
         nameLength++; // function name is at least 3 char long.
-        name[3] = *(3 + currentLine);
+        name[3] = charAt(3 + currentLine);
         if ((name[3] < 'A' || name[3] > 'Z') && (name[3] < 'a' || name[3] > 'z') && name[3] != '(')
         {
             if (name[0] == 'p' && name[1] == 'h' && name[2] == 'i' ) // just three letters => Armonic number
@@ -316,7 +335,7 @@ bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const cha
         if (name[3] != '(')
         {
             nameLength++; // function name is 4 char long.
-            if ((name[4] = *(4 + currentLine)) != '(') // bad finished function name
+            if ((name[4] = charAt(4 + currentLine)) != '(') // bad finished function name
             {
                 cLastParsed = name[0];
                 lastError = Error::unknownFunction; // Unrecognized function name.
@@ -329,13 +348,9 @@ bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const cha
     else
         name[2] = 0; // removing parenthesis from the name.
 
-    if (functionNames.empty())     // function name table not built yet, this is the very first use.
-        populateFunctionNamesTable(); // Then, populate the table just one time.
-
-    uintchar4 uKey(name);
-    functionNamesIter it = functionNames.find(uKey.number);
-
-    if (it == functionNames.end())
+    uint32_t key = packName(name);
+    const FunctionSlot& slot = functionHash.slots[functionHash.slotOf(key)];
+    if (slot.key != key) // a name hashed to the slot of another one, or to an empty slot.
     {
         cLastParsed = name[0];
         lastError = Error::unknownFunction; // Unrecognized function name.
@@ -343,14 +358,42 @@ bool  ExpressionParser::parseAlphabeticForward(OperationId & returnOp, const cha
     }
 
     currentLine += nameLength; // skip the complete function name
-    returnOp = it->second;
+    returnOp = slot.id;
     return true;
 }
 
+bool  ExpressionParser::parseVariableForward(unsigned& returnIndex, const char* & currentLine) const
+{
+    if (pVariableNames == nullptr || pVariableNames->empty())
+        return false;
+
+    size_t length = 0; // a name is a letter followed by letters, digits or underscores.
+    char c = 0;
+    while ((c = charAt(currentLine + length)) != 0 && (('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z')
+           || (length > 0 && (('0' <= c && c <= '9') || c == '_'))))
+        length++;
+
+    if (c == '(')
+        return false; // a function call, not a variable.
+
+    for (size_t u = 0; u < pVariableNames->size(); u++)
+    {
+        const std::string& name = (*pVariableNames)[u];
+        if (name.length() == length && name.compare(0, length, currentLine, length) == 0)
+        {
+            currentLine += length; // skip the complete variable name
+            returnIndex = static_cast<unsigned>(u);
+            return true;
+        }
+    }
+
+    return false; // not a declared variable, maybe a constant or a function.
+}
+
 bool  ExpressionParser::parseNewItem(const char* & currentParsingLine,
                                      SearchStrategy& newStrategy, OperationItem* newItemToComplete)
 {
-    char c = *currentParsingLine;
+    char c = charAt(currentParsingLine);
     OperationId prevId = newItemToComplete->id; // retrieve the former Id for previous iteration
     newItemToComplete->id = OperationId::number; // default initial values is for number operands
     newItemToComplete->value = 0;
@@ -367,8 +410,8 @@ bool  ExpressionParser::parseNewItem(const char* & currentParsingLine,
     }
     else if (c == '+' || c == '-')
     {
-        if (prevId == OperationId::number || prevId == OperationId::factorial
-            || prevId == OperationId::closeParenthesis)
+        if (prevId == OperationId::number || prevId == OperationId::variable
+            || prevId == OperationId::factorial || prevId == OperationId::closeParenthesis)
         {
             if (c == '+')
                 newItemToComplete->id = OperationId::plus;
@@ -387,7 +430,8 @@ bool  ExpressionParser::parseNewItem(const char* & currentParsingLine,
     }
     else if (c == '*' || c == '/' || c == '%' || c == '^' || c == '!')
     {
-        if (prevId != OperationId::number && prevId != OperationId::closeParenthesis)
+        if (prevId != OperationId::number && prevId != OperationId::variable
+            && prevId != OperationId::closeParenthesis)
         {
             lastError = Error::contiguousOp; // two consecutive operators.
             cLastParsed = c;
@@ -424,13 +468,21 @@ bool  ExpressionParser::parseNewItem(const char* & currentParsingLine,
     }
     else if(('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z'))  // posible alphabetic function names.
     {
-        if (prevId == OperationId::number)
+        if (prevId == OperationId::number || prevId == OperationId::variable)
         {
             lastError = Error::missingOp; // Missing operator between number and function name.
             cLastParsed = c;
             return false;
         }
 
+        unsigned variableIndex = 0;
+        if (parseVariableForward(variableIndex, currentParsingLine))
+        {
+            newItemToComplete->id = OperationId::variable;
+            newItemToComplete->value = variableIndex;
+            return true;
+        }
+
         OperationId opId = OperationId::openParenthesis; // initial neutral invalid value
         if (parseAlphabeticForward(opId, currentParsingLine))
         {
@@ -466,108 +518,276 @@ bool  ExpressionParser::parseNewItem(const char* & currentParsingLine,
     return true;
 }
 
-void ExpressionParser::parseExpression(const char* pcExpression)
+// Reads the next block of tokens, up to tokenBlockSize, in a single pass over the characters. It stops earlier
+// at the end of the expression, or at a wrong item (lastError set, and currentLine left where it was found).
+size_t ExpressionParser::tokenize(const char* & currentLine, OperationId& prevId, int& parenthesisBalance)
 {
-    pcExpression = expressionSanityCheck(pcExpression);
-    if (pcExpression == nullptr)
-        return;
-
-    // default values
-    OperationId prevId = OperationId::openParenthesis;  // initial operation at root node is '(',
-    OperationItem opRoot(OperationId::openParenthesis); // as an upward iteration stopper to be deleted at the end.
-
-    NodeFactory<OperationItem>* pFactory = NodeFactory<OperationItem>::getOrCreateInstance();
-
-    // Initialize the tree with the '(' node, as a mark to be deleted at the end.
-    pTree = new Tree<OperationItem>(pFactory->createNode(opRoot));
+    size_t count = 0;
     char c = 0;
-    while ((c = *pcExpression) != 0) // Loop to o the entire expression parsing.
+    while (count < tokenBlockSize && (c = charAt(currentLine)) != 0)
     {
-        if(c == '\0')
-            break;  // protective, not rationally needed.
-        else if (c == ' ' ||  c == '\t' || c == '\r' || c == '\n')
+        if (c == ' ' ||  c == '\t' || c == '\r' || c == '\n')
         {
-            pcExpression++;
+            currentLine++;
             continue;
         }
 
-        OperationItem opNewItemToRank(prevId, 0);  // Default is former Id
-        SearchStrategy search = SearchStrategy::leftToRigth; // Default is left-associative.
+        if (c == ')' && parenthesisBalance == 0)
+        {
+            lastError = Error::noMatchingParenthesis; // no '(' to match, but the root one.
+            cLastParsed = c;
+            return count;
+        }
+
+        const char* pcStart = currentLine;
+        OperationItem item(prevId);  // parseNewItem() takes the former Id from it.
+        Token& token = tokens[count];
+        token.strategy = SearchStrategy::leftToRigth; // Default is left-associative.
+        if (! parseNewItem(currentLine, token.strategy, &item))
+            return count;
 
-        if (! parseNewItem(pcExpression, search, &opNewItemToRank)) // check the new char and generate a new item
+        if (item.id == OperationId::openParenthesis)
+            parenthesisBalance++;
+        else if (item.id == OperationId::closeParenthesis)
+            parenthesisBalance--;
+
+        token.value = item.value;
+        token.offset = static_cast<uint32_t>(pcStart - szExpression);
+        token.length = static_cast<uint32_t>(currentLine - pcStart);
+        token.id = item.id;
+        prevId = item.id;
+        count++;
+    }
+
+    return count;
+}
+
+// Balance of the parenthesis from currentLine, which is left at the end of the expression.
+int  ExpressionParser::scanParenthesis(const char* & currentLine) const
+{
+    int balance = 0;
+    char c = 0;
+    while ((c = charAt(currentLine)) != 0)
+    {
+        if (c == '(')
+            balance++;
+        else if (c == ')')
+            balance--;
+
+        currentLine++;
+    }
+
+    return balance;
+}
+
+void ExpressionParser::insertToken(const Token& token)
+{
+    OperationItem opNewItemToRank(token.id);
+    opNewItemToRank.value = token.value;
+    OperationItem::adjustPriorityAndSymbolAccordingToId(opNewItemToRank);
+
+    if (verbosity >= Verbosity::full)
+    {
+        debugItem("Incoming New Item:", opNewItemToRank);
+    }
+
+    if (token.strategy != SearchStrategy::noIterate)
+    {
+        const char priority = opNewItemToRank.priority; // just what the predicates compare, not the whole item.
+        if (token.strategy == SearchStrategy::rightToLeft)
+        {
+            pTree->searchUp( [priority] (const Node<OperationItem>* pnode) -> bool {
+                // continue searching up while supplied item is less priority than current.
+                return pnode->getData().priority < priority;
+            });
+        }
+        else // left to right --> try to iterate the tree upwards.
         {
-            lastIndex = pcExpression - szExpression;
-            return;
+            pTree->searchUp( [priority] ( const Node<OperationItem>* pnode) -> bool {
+                // continue searching up while supplied item is equal or less priority than current.
+                return pnode->getData().priority <= priority;
+            });
         }
+    }
 
-        OperationItem::adjustPriorityAndSymbolAccordingToId(opNewItemToRank);
+    if(opNewItemToRank.id == OperationId::closeParenthesis)
+    {
+        // New generated ')' node must not be inserted. Matching '(' is to be removed instead.
 
+        Node<OperationItem>* pCurrent = pTree->getCurrent();
         if (verbosity >= Verbosity::full)
         {
-            debugItem("Incoming New Item:", opNewItemToRank);
+            debugNode("Deleting Current Item:", pCurrent);
         }
+        // Remove former '(' node matching the new generated ')'. Also, force the new current = parent
+        assert( pTree->deleteCurrentPreserveRight(true) );
+        pFactory->destroyNode(pCurrent);
+    }
+    else // new node creation and inserton into the tree
+    {
+        Node<OperationItem>* pNewNode = pFactory->createNode(opNewItemToRank);
 
-        if (search != SearchStrategy::noIterate)
+        if (verbosity >= Verbosity::full)
         {
-            if (search == SearchStrategy::rightToLeft)
-            {
-                pTree->searchUp( [opNewItemToRank] (const Node<OperationItem>* pnode) -> bool {
-                    // continue searching up while supplied item is less priority than current.
-                    return pnode->getData().priority < opNewItemToRank.priority;
-                });
-            }
-            else // left to right --> try to iterate the tree upwards.
-            {
-                pTree->searchUp( [opNewItemToRank] ( const Node<OperationItem>* pnode) -> bool {
-                    // continue searching up while supplied item is equal or less priority than current.
-                    return pnode->getData().priority <= opNewItemToRank.priority;
-                });
-            }
+            debugNode("Inserting New Item:", pNewNode);
         }
 
-        if(opNewItemToRank.id == OperationId::closeParenthesis)
-        {
-            // New generated ')' node must not be inserted. Matching '(' is to be removed instead.
+        bool zigzag = true; // right current subtree is going to be hang on the left of new node.
+        assert( pTree->insertUnderCurrentOnRight(pNewNode, zigzag) );
+        pTree->skipDownRight(); // make the recently inserted node the current one.
+    }
 
-            Node<OperationItem>* pCurrent = pTree->getCurrent();
-            if (verbosity >= Verbosity::full)
-            {
-                debugNode("Deleting Current Item:", pCurrent);
-            }
-            // Remove former '(' node matching the new generated ')'. Also, force the new current = parent
-            assert( pTree->deleteCurrentPreserveRight(true) );
-            pFactory->destroyNode(pCurrent);
-        }
-        else // new node creation and inserton into the tree
+    if (verbosity == Verbosity::extra)
+    {
+        printTree(std::cout);
+    }
+}
+
+// The same insertion as insertToken(), but the nodes from the root down to the current one (the right spine of the
+// tree, as every new node hangs on the right of the current one) are kept in vSpine. Climbing up is then popping
+// from it: every node is popped at most once, so the whole expression is built in linear time.
+void ExpressionParser::pushToken(const Token& token, std::vector<Node<OperationItem>*>& vSpine)
+{
+    OperationItem opNewItemToRank(token.id);
+    opNewItemToRank.value = token.value;
+
+    if (verbosity >= Verbosity::full)
+    {
+        debugItem("Incoming New Item:", opNewItemToRank);
+    }
+
+    char priority = opNewItemToRank.priority;
+    if (token.strategy == SearchStrategy::rightToLeft) // the root '(' (bottom of the stack) is never popped.
+        while (vSpine.size() > 1 && vSpine.back()->getData().priority < priority)
+            vSpine.pop_back();
+    else if (token.strategy == SearchStrategy::leftToRigth)
+        while (vSpine.size() > 1 && vSpine.back()->getData().priority <= priority)
+            vSpine.pop_back();
+
+    Node<OperationItem>* pCurrent = vSpine.back();
+    if (opNewItemToRank.id == OperationId::closeParenthesis)
+    {
+        // The matching '(' is removed, and its right subtree hung in its place.
+        if (verbosity >= Verbosity::full)
         {
-            Node<OperationItem>* pNewNode = pFactory->createNode(opNewItemToRank);
+            debugNode("Deleting Current Item:", pCurrent);
+        }
 
-            if (verbosity >= Verbosity::full)
-            {
-                debugNode("Inserting New Item:", pNewNode);
-            }
+        vSpine.pop_back();
+        assert( !vSpine.empty() && vSpine.back()->getRight() == pCurrent ); // tokenize() matched every ')'.
+        Node<OperationItem>* pRight = pCurrent->getRight();
+        vSpine.back()->setRight(pRight);
+        if (pRight != nullptr)
+            pRight->setParent(vSpine.back());
+
+        pFactory->destroyNode(pCurrent);
+    }
+    else // the new node hangs on the right of the current one, and the right subtree of the latter on its left.
+    {
+        Node<OperationItem>* pNewNode = pFactory->createNode(opNewItemToRank);
 
-            bool zigzag = true; // right current subtree is going to be hang on the left of new node.
-            assert( pTree->insertUnderCurrentOnRight(pNewNode, zigzag) );
-            pTree->skipDownRight(); // make the recently inserted node the current one.
+        if (verbosity >= Verbosity::full)
+        {
+            debugNode("Inserting New Item:", pNewNode);
         }
 
-        if (verbosity == Verbosity::extra)
+        Node<OperationItem>* pUnder = pCurrent->getRight();
+        pCurrent->setRight(pNewNode);
+        pNewNode->setParent(pCurrent);
+        pNewNode->setLeft(pUnder);
+        if (pUnder != nullptr)
+            pUnder->setParent(pNewNode);
+
+        vSpine.push_back(pNewNode);
+    }
+
+    if (verbosity == Verbosity::extra)
+    {
+        printTree(std::cout);
+    }
+}
+
+// The expression is read just once: every block of tokens is inserted into the tree as soon as it is read.
+// An unbalanced expression is still reported before any wrong item, at its end, so after a wrong item the
+// rest of the expression is only scanned for parenthesis.
+void ExpressionParser::parseExpression(const char* pcExpression)
+{
+    PhaseStatistics* pStats = PhaseStatistics::current(); // null (nothing timed) unless statistics are on.
+    uint64_t phaseStart = (pStats ? PhaseStatistics::now() : 0);
+    uint64_t tokenizingNs = 0;
+
+    if (pcExpression == nullptr || charAt(pcExpression) == '\0')
+    {
+        lastError = Error::voidExpression; // no expression to parse.
+        return;
+    }
+
+    OperationId prevId = OperationId::openParenthesis; // initial operation at root node is '('.
+    int parenthesisBalance = 0;
+    size_t count = 0;
+    static thread_local std::vector<Node<OperationItem>*> vSpine; // of the operator stack engine, kept allocated.
+    vSpine.clear();
+    do
+    {
+        uint64_t tokenStart = (pStats ? PhaseStatistics::now() : 0);
+        count = tokenize(pcExpression, prevId, parenthesisBalance);
+        if (pStats)
+            tokenizingNs += PhaseStatistics::now() - tokenStart;
+
+        if (pTree == nullptr && (count > 0 || lastError != Error::success)) // not a void expression.
         {
-            printTree(std::cout);
+            // Initialize the tree with the '(' node, as an upward iteration stopper to be deleted at the end.
+            OperationItem opRoot(OperationId::openParenthesis);
+            tree.setRootAndCurrent(pFactory->createNode(opRoot));
+            pTree = &tree;
+            pFactory->openTree();
+            vSpine.push_back(pTree->getRoot());
         }
 
-        prevId = opNewItemToRank.id; // prepare for next iteration
+        if (engine == Engine::operatorStack)
+            for (size_t i = 0; i < count; i++)
+                pushToken(tokens[i], vSpine);
+        else
+            for (size_t i = 0; i < count; i++)
+                insertToken(tokens[i]);
+    }
+    while (count == tokenBlockSize && lastError == Error::success);
+
+    if (lastError != Error::success)
+    {
+        lastIndex = pcExpression - szExpression;
+        parenthesisBalance += scanParenthesis(pcExpression);
+    }
+
+    if (pTree == nullptr)
+    {
+        lastError = Error::voidExpression; // void input expression
+        cLastParsed = ' ';
+        lastIndex = pcExpression - szExpression;
+        return;
     }
+    else if (parenthesisBalance != 0)
+    {
+        destroyTree();
+        lastError = Error::noMatchingParenthesis; // no matching parenthesis found
+        cLastParsed = ' ';
+        lastIndex = pcExpression - szExpression;
+        return;
+    }
+    else if (lastError != Error::success)
+        return;
 
     // Finally remove the '(' node as a root node.
     removeFakeOpenParenthesisRoot();
+    if (pStats) // the rest of the parsing time went to build the tree.
+    {
+        pStats->record(PhaseStatistics::Phase::tokenizing, tokenizingNs);
+        pStats->record(PhaseStatistics::Phase::treeBuilding, PhaseStatistics::now() - phaseStart - tokenizingNs);
+    }
 }
 
 void  ExpressionParser::removeFakeOpenParenthesisRoot()
 {
-    NodeFactory<OperationItem>* pFactory = NodeFactory<OperationItem>::getOrCreateInstance();
-
     Node<OperationItem>* pCurrentRoot = pTree->getRoot();
     Node<OperationItem>* pNewRoot = pCurrentRoot->getRight();
     if (pNewRoot != nullptr)
@@ -597,15 +817,30 @@ void  ExpressionParser::printNode( const Node<OperationItem>* pNode, int indent,
             os << "----------------- AST TREE -----------------\n";
     }
 
-    if (!norecursive)
-        printNode(pNode->getRight(), indent + indentMargin, os, norecursive);
+    if (norecursive)
+    {
+        printItem(pNode, indent, os);
+        return;
+    }
+
+    // Right subtree above, left one below: in-order from right to left, without recursion.
+    Tree<OperationItem>::visitInOrder(const_cast<Node<OperationItem>*>(pNode),
+        [this, indent, &os] (const Node<OperationItem>* pItem, size_t depth) {
+            printItem(pItem, indent + indentMargin * static_cast<int>(depth), os);
+        }, true);
+}
 
+void  ExpressionParser::printItem(const Node<OperationItem>* pNode, int indent, std::ostream& os) const
+{
     OperationItem nodeData(pNode->getData());
     os << std::string(indent, ' ') << "(";
     if (OperationId::first <= nodeData.id && nodeData.id < OperationId::total)
     {
         if (nodeData.id == OperationId::number)
             os << nodeData.value;
+        else if (nodeData.id == OperationId::variable && pVariableNames != nullptr
+                 && nodeData.value < pVariableNames->size())
+            os << (*pVariableNames)[static_cast<size_t>(nodeData.value)];
         else
             os << nodeData.symbol;
     }
@@ -617,28 +852,59 @@ void  ExpressionParser::printNode( const Node<OperationItem>* pNode, int indent,
         os << int(nodeData.priority) << "!   #" << pNode->getSequenceNo();
 
     os << std::endl;
-
-    if (!norecursive)
-      printNode(pNode->getLeft(), indent + indentMargin, os, norecursive);
 }
 
 void  ExpressionParser::destroyNode( Node<OperationItem>* const pNode,
-                                     bool norecursive /* = false */)
+                                     bool norecursive /* = false */, unsigned depth /* = 0 */)
 {
     if (pNode == nullptr) return;
 
-    if (!norecursive)
+    if (!norecursive && depth == maxRecursionDepth)
+    {
+        destroySubtree(pNode); // the deeper levels, without recursion.
+        return;
+    }
+
+    if (!norecursive) // just the owned children, a shared one is destroyed from its owner (pParent).
     {
-        destroyNode(pNode->getLeft());
-        destroyNode(pNode->getRight());
+        Node<OperationItem>* pLeft = pNode->getLeft();
+        Node<OperationItem>* pRight = pNode->getRight(); // the left one too, if both operands were shared ("b*b").
+        if (pLeft != nullptr && pLeft->getParent() == pNode)
+            destroyNode(pLeft, false, depth + 1);
+        if (pRight != nullptr && pRight != pLeft && pRight->getParent() == pNode)
+            destroyNode(pRight, false, depth + 1);
     }
 
-    NodeFactory<OperationItem>::getOrCreateInstance()->destroyNode(pNode);
+    pFactory->destroyNode(pNode);
+}
+
+// Post-order, with a Tree iterator, along the owning edges only (like destroyNode()).
+void  ExpressionParser::destroySubtree(Node<OperationItem>* const pTop)
+{
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTop); it.next(); )
+    {
+        Node<OperationItem>* pFrom = it.getFrom();
+        bool owned = (pFrom == nullptr || it.getNode()->getParent() == pFrom);
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter && !owned)
+            it.skipChildren();
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::between
+                 && it.getNode()->getLeft() == it.getNode()->getRight())
+            it.skipChildren(); // both operands are one shared node, already destroyed through the left edge.
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::leave && owned)
+            pFactory->destroyNode(it.getNode());
+    }
 }
 
 void  ExpressionParser::destroyTree()
 {
-    destroyNode(pTree->getRoot());
-    delete pTree;
+    bool lastTree = (pFactory->closeTree() == 0);
+    if (pFactory->getAllocation() != NodeFactory<OperationItem>::Allocation::arena)
+        destroyNode(pTree->getRoot());
+    else if (lastTree)
+        pFactory->reset(); // O(1) release of this expression, and of the ones of the parsers gone before.
+    // otherwise other parsers still have trees in the arena: its nodes come back with the reset of the last one.
+
+    tree.setRootAndCurrent(nullptr);
     pTree = nullptr;
 }
@@ -0,0 +1,127 @@
+/**
+ * @file GammaFunction.cpp
+ * @brief Gamma function and factorials: exact tables for the integers, a rational function and Stirling's
+ *        series for the rest. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-04-12
+ */
+
+#include <cmath>
+#include "GammaFunction.h"
+
+// hi + lo times a double, kept as a double-double: fma() gives the rounding error of the product.
+static inline void multiply(double& hi, double& lo, double factor)
+{
+    double product = hi * factor;
+    double error = std::fma(hi, factor, -product) + lo * factor;
+    hi = product + error;
+    lo = error - (hi - product);
+}
+
+double GammaFunction::factorial(double n)
+{
+    if (0 <= n && n <= maxFactorial && n == floor(n))
+        return factorials[static_cast<size_t>(n)];
+
+    return gamma(n + 1.0);
+}
+
+double GammaFunction::gamma(double x)
+{
+    if (x == floor(x)) // the integers and the infinities.
+    {
+        if (1 <= x && x <= maxFactorial + 1)
+            return factorials[static_cast<size_t>(x) - 1];
+        else if (x == 0)
+            return copysign(HUGE_VAL, x); // a pole, signed as the zero.
+        else if (x > 0)
+            return HUGE_VAL;
+        else
+            return NAN; // as tgamma(), at the poles of the negative integers.
+    }
+
+    double q = fabs(x);
+    if (!(q > 33.0)) // NaN too.
+        return rational(x);
+    else if (x > 0)
+        return (x > maxArgument ? HUGE_VAL : stirling(x));
+    else if (q > maxArgument)
+        return std::tgamma(x); // underflows, maybe to a subnormal number.
+
+    // Euler's reflection: gamma(x) = -pi / (q * sin(pi*q) * gamma(q)), x = -q. sin(pi*z), |z| <= 1/2, is
+    // |sin(pi*q)|, whose sign is the one of the integer part of q.
+    double p = floor(q);
+    double sign = (static_cast<long long>(p) % 2 == 0 ? -1.0 : 1.0);
+    double z = q - p;
+    if (z > 0.5)
+        z = q - (p + 1.0);
+    z = fabs(q * sin(M_PI * z));
+    return sign * (M_PI / z / stirling(q)); // not pi / (z * stirling(q)), whose product overflows near q = 171.
+}
+
+// Cephes stirf(): sqrt(2*pi) * x^(x - 1/2) / e^x * (1 + S(1/x)/x), a minimax fit of Stirling's series.
+// 33 < x <= maxArgument.
+double GammaFunction::stirling(double x)
+{
+    const double s[5] =
+    {
+        7.87311395793093628397e-04, -2.29549961613378126380e-04, -2.68132617805781232825e-03,
+        3.47222221605458667310e-03, 8.33333333333482257126e-02
+    };
+    const double sqrtTwoPi = 2.50662827463100050242, maxPower = 143.01608; // x^(x - 1/2) overflows over it.
+
+    double w = 1.0 / x;
+    double series = s[0];
+    for (int i = 1; i < 5; i++)
+        series = series * w + s[i];
+    w = 1.0 + w * series;
+
+    double y = exp(x);
+    if (x > maxPower) // in two halves.
+    {
+        double v = pow(x, 0.5 * x - 0.25);
+        y = v * (v / y);
+    }
+    else
+        y = pow(x, x - 0.5) / y;
+    return sqrtTwoPi * y * w;
+}
+
+// Cephes gamma() under 33: brought to [2, 3) by gamma(x + 1) = x * gamma(x), then a rational function. The
+// factors of the recurrence are multiplied in double-double, so that their 30 odd roundings add up to one.
+double GammaFunction::rational(double x)
+{
+    const double p[7] =
+    {
+        1.60119522476751861407e-04, 1.19135147006586384913e-03, 1.04213797561761569935e-02,
+        4.76367800457137231464e-02, 2.07448227648435975150e-01, 4.94214826801497100753e-01,
+        9.99999999999999996796e-01
+    };
+    const double q[8] =
+    {
+        -2.31581873324120129819e-05, 5.39605580493303397842e-04, -4.45641913851797240494e-03,
+        1.18139785222060435552e-02, 3.58236398605498653373e-02, -2.34591795718243348568e-01,
+        7.14304917030273074085e-02, 1.00000000000000000320e+00
+    };
+
+    double aboveHi = 1.0, aboveLo = 0.0, belowHi = 1.0, belowLo = 0.0;
+    while (x >= 3.0)
+    {
+        x -= 1.0;
+        multiply(aboveHi, aboveLo, x);
+    }
+
+    while (x < 2.0)
+    {
+        multiply(belowHi, belowLo, x);
+        x += 1.0;
+    }
+
+    x -= 2.0;
+    double numerator = p[0], denominator = q[0];
+    for (int i = 1; i < 7; i++)
+        numerator = numerator * x + p[i];
+    for (int i = 1; i < 8; i++)
+        denominator = denominator * x + q[i];
+    return (aboveHi + aboveLo) / (belowHi + belowLo) * (numerator / denominator);
+}
@@ -0,0 +1,389 @@
+/**
+ * @file JitExpression.cpp
+ * @brief Operand/operator/operand binary tree compiled into x86-64 machine code. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-22
+ */
+
+#include <cmath>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "ArithmeticEvaluator.h"
+#include "CompiledExpression.h"
+#include "JitExpression.h"
+#include "OperationItem.h"
+
+bool JitExpression::isSupported()
+{
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool JitExpression::hasFusedMultiplyAdd()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __builtin_cpu_supports("fma"); // checks that the OS saves the AVX registers too.
+#else
+    return false;
+#endif
+}
+
+bool JitExpression::compile(const Tree<OperationItem>* pTree, bool fusedMultiplyAdd /* = false */)
+{
+    CompiledExpression program(pTree); // the postfix program is the lowering step.
+    return compile(program, fusedMultiplyAdd);
+}
+
+bool JitExpression::compile(const CompiledExpression& program, bool fusedMultiplyAdd /* = false */)
+{
+    release();
+    if (!isSupported() || program.isEmpty() || program.getStackDepth() + program.getSharedCount() > maxFrameSlots)
+        return false;
+
+    fused = fusedMultiplyAdd && hasFusedMultiplyAdd();
+    lower(program);
+    codeSize = vBytes.size();
+
+    // Code, then the constant pool and the zeros standing for missing variables, in the same mapping.
+    size_t dataBase = (codeSize + 15) & ~size_t(15);
+    size_t variableCount = program.getVariableCount() > 0 ? program.getVariableCount() : 1;
+    size_t totalSize = dataBase + (program.getConstants().size() + variableCount) * sizeof(double);
+    for (const Fixup& fixup : vFixups)
+    {
+        int32_t displacement = static_cast<int32_t>(dataBase + fixup.dataOffset - (fixup.position + 4));
+        memcpy(&vBytes[fixup.position], &displacement, sizeof(displacement));
+    }
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mappedSize = (totalSize + pageSize - 1) / pageSize * pageSize;
+    void* pMapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMapped == MAP_FAILED)
+    {
+        mappedSize = codeSize = 0;
+        vBytes.clear();
+        vFixups.clear();
+        return false;
+    }
+
+    uint8_t* pBytes = static_cast<uint8_t*>(pMapped); // fresh anonymous pages: the zeros are already there.
+    memcpy(pBytes, vBytes.data(), codeSize);
+    memcpy(pBytes + dataBase, program.getConstants().data(), program.getConstants().size() * sizeof(double));
+    vBytes.clear();
+    vFixups.clear();
+    if (mprotect(pMapped, mappedSize, PROT_READ | PROT_EXEC) != 0) // never writable and executable at once.
+    {
+        munmap(pMapped, mappedSize);
+        mappedSize = codeSize = 0;
+        return false;
+    }
+
+    pCode = pMapped;
+    return true;
+}
+
+void JitExpression::release()
+{
+    if (pCode != nullptr)
+        munmap(pCode, mappedSize);
+
+    pCode = nullptr;
+    mappedSize = codeSize = 0;
+    fused = false;
+}
+
+// The libm functions ArithmeticEvaluator::operate() returns as they are, called directly.
+static uintptr_t libmFunction(OperationId id)
+{
+    using Unary = double (*)(double);
+    Unary function = nullptr;
+    switch (id)
+    {
+    case OperationId::sin:   function = static_cast<Unary>(std::sin);    break;
+    case OperationId::cos:   function = static_cast<Unary>(std::cos);    break;
+    case OperationId::tan:   function = static_cast<Unary>(std::tan);    break;
+    case OperationId::sinh:  function = static_cast<Unary>(std::sinh);   break;
+    case OperationId::cosh:  function = static_cast<Unary>(std::cosh);   break;
+    case OperationId::tanh:  function = static_cast<Unary>(std::tanh);   break;
+    case OperationId::exp:   function = static_cast<Unary>(std::exp);    break;
+    case OperationId::asin:  function = static_cast<Unary>(std::asin);   break;
+    case OperationId::acos:  function = static_cast<Unary>(std::acos);   break;
+    case OperationId::atan:  function = static_cast<Unary>(std::atan);   break;
+    case OperationId::asinh: function = static_cast<Unary>(std::asinh);  break;
+    case OperationId::acosh: function = static_cast<Unary>(std::acosh);  break;
+    case OperationId::atanh: function = static_cast<Unary>(std::atanh);  break;
+    case OperationId::ln:    function = static_cast<Unary>(std::log);    break;
+    case OperationId::log10: function = static_cast<Unary>(std::log10);  break;
+    case OperationId::log2:  function = static_cast<Unary>(std::log2);   break;
+    default: break; // the square and cubic roots, gama, the factorial and unary + are computed by operate().
+    }
+
+    return reinterpret_cast<uintptr_t>(function);
+}
+
+static bool isLoad(OperationId id)
+{
+    return id == OperationId::number || id == OperationId::variable || id == CompiledExpression::loadShared;
+}
+
+// The stack machine of CompiledExpression::run() with its operands in registers: the position p of the stack
+// is xmm(3 + p), and the deeper ones are slots of the machine stack frame ([rsp + 8 * p]), followed by the shared
+// results. Around a call, the registers still in use are spilled into their slots. rbx holds the variables.
+void JitExpression::lower(const CompiledExpression& program)
+{
+    const std::vector<CompiledExpression::Instruction>& vCode = program.getCode();
+    const size_t stackDepth = program.getStackDepth();
+    const uint32_t zerosOffset = static_cast<uint32_t>(program.getConstants().size() * sizeof(double));
+    const uint32_t frameSize = static_cast<uint32_t>(((stackDepth + program.getSharedCount()) * 8 + 15) & ~15u);
+    const uintptr_t operate = reinterpret_cast<uintptr_t>(&ArithmeticEvaluator::operate);
+
+    vBytes.clear();
+    vFixups.clear();
+    emit({0x53});                                    // push rbx (the stack gets 16 bytes aligned, for the calls)
+    emit({0x48, 0x81, 0xEC}); emit32(frameSize);     // sub rsp, frameSize
+    if (program.getVariableCount() > 0)
+    {
+        emit({0x48, 0x8D, 0x05});                    // lea rax, [rip + zeros]
+        vFixups.push_back({vBytes.size(), zerosOffset});
+        emit32(0);
+        emit({0x48, 0x85, 0xFF});                    // test rdi, rdi
+        emit({0x48, 0x0F, 0x44, 0xF8});              // cmovz rdi, rax
+        emit({0x48, 0x89, 0xFB});                    // mov rbx, rdi
+    }
+
+    size_t depth = 0; // operands on the stack.
+    for (size_t i = 0; i < vCode.size(); i++)
+    {
+        const CompiledExpression::Instruction& instr = vCode[i];
+        OperationId id = instr.id;
+        if (isLoad(id))
+        {
+            int reg = (depth < stackRegisters ? firstStackRegister + static_cast<int>(depth) : 0);
+            load(reg, id, instr.operand, stackDepth);
+            settle(depth++, reg);
+            continue;
+        }
+        else if (id == CompiledExpression::storeShared)
+        {
+            int reg = locate(depth - 1, 0);
+            emitSseMemory(0xF2, 0x11, reg, Base::rsp, static_cast<uint32_t>((stackDepth + instr.operand) * 8));
+            continue;
+        }
+
+        if (id == OperationId::multiply && fused) // a*b, then added or subtracted, rounded once.
+        {
+            OperationId next = (i + 1 < vCode.size() ? vCode[i + 1].id : OperationId::total);
+            OperationId after = (i + 2 < vCode.size() ? vCode[i + 2].id : OperationId::total);
+            if (next == OperationId::plus || next == OperationId::minus) // c a b * +-, into c.
+            {
+                int c = locate(depth - 3, 0);
+                int a = locate(depth - 2, 1);
+                int b = locate(depth - 1, 2);
+                emitFused(next == OperationId::plus ? 0xB9 : 0xBD, c, a, b); // vfmadd231sd / vfnmadd231sd
+                settle(depth - 3, c);
+                depth -= 2;
+                i += 1;
+                continue;
+            }
+            else if (isLoad(next) && (after == OperationId::plus || after == OperationId::minus)) // a b * c +-
+            {
+                int a = locate(depth - 2, 0);
+                int b = locate(depth - 1, 1);
+                load(2, next, vCode[i + 1].operand, stackDepth);
+                emitFused(after == OperationId::plus ? 0xA9 : 0xAB, a, b, 2); // vfmadd213sd / vfmsub213sd
+                settle(depth - 2, a);
+                depth -= 1;
+                i += 2;
+                continue;
+            }
+        }
+
+        switch (id)
+        {
+        case OperationId::multiply:
+        case OperationId::divide:
+        case OperationId::plus:
+        case OperationId::minus:
+        {
+            static const uint8_t opcodes[] = {0x59, 0x5E, 0x58, 0x5C}; // mulsd, divsd, addsd, subsd
+            uint8_t opcode = (id == OperationId::multiply ? opcodes[0] : id == OperationId::divide ? opcodes[1]
+                              : id == OperationId::plus ? opcodes[2] : opcodes[3]);
+            int left = locate(depth - 2, 0);
+            int right = locate(depth - 1, 1);
+            emitSse(0xF2, opcode, left, right);      // left op= right, the left operand first (like in C).
+            settle(depth - 2, left);
+            depth--;
+            break;
+        }
+
+        case OperationId::power:
+        case OperationId::reminder:
+        {
+            spill(depth - 2, false);
+            int left = locate(depth - 2, 0);
+            int right = locate(depth - 1, 1);
+            if (left != 0)
+                emitSse(0x66, 0x28, 0, left);        // movapd xmm0, left
+            if (right != 1)
+                emitSse(0x66, 0x28, 1, right);       // movapd xmm1, right
+            emit({0xBF}); emit32(static_cast<uint32_t>(id)); // mov edi, id
+            callFunction(operate);
+            spill(depth - 2, true);
+            depth--;
+            if (depth - 1 < stackRegisters)
+                emitSse(0x66, 0x28, firstStackRegister + static_cast<int>(depth - 1), 0);
+            else
+                settle(depth - 1, 0);
+            break;
+        }
+
+        case OperationId::negative: // the sign bit flipped, like -x.
+        {
+            int reg = locate(depth - 1, 0);
+            uint8_t rex = static_cast<uint8_t>(0x48 | (reg >= 8 ? 4 : 0));
+            uint8_t modrm = static_cast<uint8_t>(0xC0 | (reg & 7) << 3);
+            emit({0x66, rex, 0x0F, 0x7E, modrm});    // movq rax, xmm<reg>
+            emit({0x48, 0x0F, 0xBA, 0xF8, 0x3F});    // btc rax, 63
+            emit({0x66, rex, 0x0F, 0x6E, modrm});    // movq xmm<reg>, rax
+            settle(depth - 1, reg);
+            break;
+        }
+
+        default: // functions and unary +, over their right operand, and the factorial, over its left one.
+        {
+            spill(depth - 1, false);
+            int arg = locate(depth - 1, 0);
+            uintptr_t function = libmFunction(id);
+            if (function != 0)
+            {
+                if (arg != 0)
+                    emitSse(0x66, 0x28, 0, arg);     // movapd xmm0, arg
+            }
+            else if (id == OperationId::factorial)
+            {
+                if (arg != 0)
+                    emitSse(0x66, 0x28, 0, arg);     // movapd xmm0, arg
+                emitSse(0x66, 0x57, 1, 1);           // xorpd xmm1, xmm1
+            }
+            else
+            {
+                emitSse(0x66, 0x28, 1, arg);         // movapd xmm1, arg
+                emitSse(0x66, 0x57, 0, 0);           // xorpd xmm0, xmm0
+            }
+
+            if (function == 0)
+            {
+                emit({0xBF}); emit32(static_cast<uint32_t>(id)); // mov edi, id
+                function = operate;
+            }
+
+            callFunction(function);
+            spill(depth - 1, true);
+            if (depth - 1 < stackRegisters)
+                emitSse(0x66, 0x28, firstStackRegister + static_cast<int>(depth - 1), 0);
+            else
+                settle(depth - 1, 0);
+            break;
+        }
+        }
+    }
+
+    int result = locate(0, 0);
+    if (result != 0)
+        emitSse(0x66, 0x28, 0, result);              // movapd xmm0, result
+    emit({0x48, 0x81, 0xC4}); emit32(frameSize);     // add rsp, frameSize
+    emit({0x5B, 0xC3});                              // pop rbx; ret
+}
+
+// The register of a stack position, or the scratch register it is loaded into when it is in the frame.
+int JitExpression::locate(size_t position, int scratch)
+{
+    if (position < stackRegisters)
+        return firstStackRegister + static_cast<int>(position);
+
+    emitSseMemory(0xF2, 0x10, scratch, Base::rsp, static_cast<uint32_t>(position * 8)); // movsd xmm, [rsp + slot]
+    return scratch;
+}
+
+// Back into the frame, when the stack position is not a register.
+void JitExpression::settle(size_t position, int reg)
+{
+    if (position >= stackRegisters)
+        emitSseMemory(0xF2, 0x11, reg, Base::rsp, static_cast<uint32_t>(position * 8)); // movsd [rsp + slot], xmm
+}
+
+// The registers of the first positions, which a call would clobber, saved into their slots (or restored).
+void JitExpression::spill(size_t positions, bool restore)
+{
+    for (size_t position = 0; position < positions && position < stackRegisters; position++)
+        emitSseMemory(0xF2, restore ? 0x10 : 0x11, firstStackRegister + static_cast<int>(position), Base::rsp,
+                      static_cast<uint32_t>(position * 8));
+}
+
+void JitExpression::load(int reg, OperationId id, uint32_t operand, size_t stackDepth)
+{
+    if (id == OperationId::number)
+        emitSseMemory(0xF2, 0x10, reg, Base::rip, static_cast<uint32_t>(operand * sizeof(double)));
+    else if (id == OperationId::variable)
+        emitSseMemory(0xF2, 0x10, reg, Base::rbx, static_cast<uint32_t>(operand * sizeof(double)));
+    else
+        emitSseMemory(0xF2, 0x10, reg, Base::rsp, static_cast<uint32_t>((stackDepth + operand) * 8));
+}
+
+void JitExpression::callFunction(uintptr_t function)
+{
+    emit({0x48, 0xB8}); emit64(function);            // mov rax, function
+    emit({0xFF, 0xD0});                              // call rax
+}
+
+// prefix [REX] 0F opcode with xmm<reg>, xmm<rm>.
+void JitExpression::emitSse(uint8_t prefix, uint8_t opcode, int reg, int rm)
+{
+    vBytes.push_back(prefix);
+    if (reg >= 8 || rm >= 8)
+        vBytes.push_back(static_cast<uint8_t>(0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0)));
+    emit({0x0F, opcode, static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))});
+}
+
+// prefix [REX] 0F opcode with xmm<reg>, [base + displacement] (a data offset for rip, patched by compile()).
+void JitExpression::emitSseMemory(uint8_t prefix, uint8_t opcode, int reg, Base base, uint32_t displacement)
+{
+    vBytes.push_back(prefix);
+    if (reg >= 8)
+        vBytes.push_back(0x44);
+    emit({0x0F, opcode});
+    if (base == Base::rsp)
+        emit({static_cast<uint8_t>(0x84 | (reg & 7) << 3), 0x24});
+    else if (base == Base::rbx)
+        emit({static_cast<uint8_t>(0x83 | (reg & 7) << 3)});
+    else
+    {
+        emit({static_cast<uint8_t>(0x05 | (reg & 7) << 3)});
+        vFixups.push_back({vBytes.size(), displacement});
+        displacement = 0;
+    }
+    emit32(displacement);
+}
+
+// VEX encoded FMA (0F38, W1, 66) with xmm<reg>, xmm<vreg>, xmm<rm>.
+void JitExpression::emitFused(uint8_t opcode, int reg, int vreg, int rm)
+{
+    emit({0xC4, static_cast<uint8_t>((reg >= 8 ? 0 : 0x80) | 0x40 | (rm >= 8 ? 0 : 0x20) | 0x02),
+          static_cast<uint8_t>(0x80 | (~vreg & 15) << 3 | 0x01), opcode,
+          static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))});
+}
+
+void JitExpression::emit32(uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        vBytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+void JitExpression::emit64(uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        vBytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
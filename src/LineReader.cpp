@@ -0,0 +1,184 @@
+/**
+ * @file LineReader.cpp
+ * @brief Reader of one expression per line, from a file or the standard input.
+ *        Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-01-19
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "LineReader.h"
+
+LineReader::LineReader()
+    : fd(-1)
+    , ownFd(false)
+    , pMap(nullptr)
+    , mapSize(0)
+    , mapOffset(0)
+    , mapReleased(0)
+    , bufferBegin(0)
+    , bufferEnd(0)
+    , endOfInput(true)
+    , keepEmptyLines(false)
+{
+}
+
+bool LineReader::open(const char* path, bool keepEmpty /* = false */)
+{
+    close();
+    keepEmptyLines = keepEmpty;
+    if (path == nullptr || strcmp(path, "-") == 0)
+    {
+        fd = STDIN_FILENO;
+        ownFd = false;
+    }
+    else if ((fd = ::open(path, O_RDONLY)) < 0)
+        return false;
+    else
+        ownFd = true;
+
+    endOfInput = false;
+    if (!mapFile()) // not a regular file (a pipe, a terminal ...), so it is read through the buffer.
+        buffer.resize(bufferSize);
+
+    return true;
+}
+
+void LineReader::close()
+{
+    if (pMap != nullptr)
+        munmap(const_cast<char*>(pMap), mapSize);
+
+    if (ownFd && fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    ownFd = false;
+    pMap = nullptr;
+    mapSize = mapOffset = mapReleased = 0;
+    bufferBegin = bufferEnd = 0;
+    endOfInput = true;
+}
+
+bool LineReader::mapFile()
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return false;
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    pMap = static_cast<const char*>(p);
+    mapSize = st.st_size;
+    return true;
+}
+
+size_t LineReader::readLines(std::vector<Line>& lines, size_t maxLines)
+{
+    lines.clear();
+    if (fd < 0)
+        return 0;
+
+    return isMapped() ? readMappedLines(lines, maxLines) : readStreamLines(lines, maxLines);
+}
+
+void LineReader::addLine(std::vector<Line>& lines, const char* text, size_t length)
+{
+    if (length > 0 && text[length - 1] == '\r')
+        length--;
+
+    if (length > 0 || keepEmptyLines) // empty lines are just skipped, unless asked for.
+        lines.push_back({text, length});
+}
+
+size_t LineReader::readMappedLines(std::vector<Line>& lines, size_t maxLines)
+{
+    releaseConsumedPages(); // the lines of the former call are not in use anymore.
+
+    while (lines.size() < maxLines && mapOffset < mapSize)
+    {
+        const char* pLine = pMap + mapOffset;
+        const char* pEol = static_cast<const char*>(memchr(pLine, '\n', mapSize - mapOffset));
+        size_t length = (pEol != nullptr ? pEol - pLine : mapSize - mapOffset);
+        addLine(lines, pLine, length);
+        mapOffset += length + (pEol != nullptr ? 1 : 0);
+    }
+
+    return lines.size();
+}
+
+void LineReader::releaseConsumedPages()
+{
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t consumed = mapOffset / page * page;
+    if (consumed - mapReleased >= releaseStep) // so resident memory stays bounded on huge files.
+    {
+        madvise(const_cast<char*>(pMap) + mapReleased, consumed - mapReleased, MADV_DONTNEED);
+        mapReleased = consumed;
+    }
+}
+
+size_t LineReader::readStreamLines(std::vector<Line>& lines, size_t maxLines)
+{
+    if (bufferBegin == bufferEnd) // nothing pending, and the former lines are not in use anymore.
+        bufferBegin = bufferEnd = 0;
+
+    size_t scanned = bufferBegin; // no new line char before this position of the current line.
+    while (lines.size() < maxLines)
+    {
+        char* pLine = buffer.data() + bufferBegin;
+        char* pEol = static_cast<char*>(memchr(buffer.data() + scanned, '\n', bufferEnd - scanned));
+        if (pEol != nullptr)
+        {
+            addLine(lines, pLine, pEol - pLine);
+            scanned = bufferBegin = pEol + 1 - buffer.data();
+            continue;
+        }
+
+        scanned = bufferEnd;
+        if (endOfInput)
+        {
+            if (bufferEnd > bufferBegin) // not just the end after the last new line char.
+                addLine(lines, pLine, bufferEnd - bufferBegin); // last line without new line char.
+            bufferBegin = bufferEnd;
+            break;
+        }
+
+        if (bufferEnd == buffer.size())
+        {
+            if (!lines.empty())
+                break; // no more room in this block, the partial line goes on in the next one.
+
+            if (bufferBegin > 0) // moved to the front only now, so that reading a line at a time stays linear.
+            {
+                memmove(buffer.data(), buffer.data() + bufferBegin, bufferEnd - bufferBegin);
+                bufferEnd -= bufferBegin;
+                scanned -= bufferBegin;
+                bufferBegin = 0;
+                continue;
+            }
+
+            buffer.resize(2 * buffer.size()); // a single line longer than the whole buffer.
+        }
+
+        ssize_t n = 0;
+        do
+            n = read(fd, buffer.data() + bufferEnd, buffer.size() - bufferEnd);
+        while (n < 0 && errno == EINTR);
+
+        if (n <= 0)
+            endOfInput = true;
+        else
+            bufferEnd += n;
+    }
+
+    return lines.size();
+}
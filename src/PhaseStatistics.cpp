@@ -0,0 +1,125 @@
+/**
+ * @file PhaseStatistics.cpp
+ * @brief Cumulative times, counts and latency histograms of the phases an expression goes through.
+ *        Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-03-01
+ */
+
+#include <cstring>
+#include <iomanip>
+#include "PhaseStatistics.h"
+
+static const char* phaseNames[static_cast<size_t>(PhaseStatistics::Phase::total)] =
+{
+    "tokenizing", "tree building", "evaluation", "tabulation", "output"
+};
+
+const char* PhaseStatistics::getPhaseName(Phase phase)
+{
+    return phase < Phase::total ? phaseNames[static_cast<size_t>(phase)] : "";
+}
+
+// Values under subBuckets have a bucket each, the other ones fall in one of the subBuckets
+// linear buckets of their power of two.
+unsigned PhaseStatistics::bucketOf(uint64_t ns)
+{
+    if (ns < subBuckets)
+        return static_cast<unsigned>(ns);
+
+    unsigned exponent = 63 - __builtin_clzll(ns); // >= subBucketBits
+    unsigned sub = static_cast<unsigned>(ns >> (exponent - subBucketBits)) & (subBuckets - 1);
+    return (exponent - subBucketBits + 1) * subBuckets + sub;
+}
+
+uint64_t PhaseStatistics::bucketUpperBound(unsigned bucket)
+{
+    if (bucket < subBuckets)
+        return bucket;
+
+    unsigned exponent = bucket / subBuckets + subBucketBits - 1;
+    uint64_t sub = bucket % subBuckets;
+    uint64_t width = uint64_t(1) << (exponent - subBucketBits);
+    return ((subBuckets + sub) << (exponent - subBucketBits)) + width - 1;
+}
+
+void PhaseStatistics::Histogram::record(uint64_t ns)
+{
+    count++;
+    totalNs += ns;
+    if (ns > maxNs)
+        maxNs = ns;
+    buckets[bucketOf(ns)]++;
+}
+
+void PhaseStatistics::Histogram::merge(const Histogram& h)
+{
+    count += h.count;
+    totalNs += h.totalNs;
+    if (h.maxNs > maxNs)
+        maxNs = h.maxNs;
+    for (unsigned b = 0; b < bucketCount; b++)
+        buckets[b] += h.buckets[b];
+}
+
+uint64_t PhaseStatistics::Histogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(p * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t accumulated = 0;
+    for (unsigned b = 0; b < bucketCount; b++)
+    {
+        accumulated += buckets[b];
+        if (accumulated >= rank)
+        {
+            uint64_t bound = bucketUpperBound(b);
+            return bound < maxNs ? bound : maxNs;
+        }
+    }
+
+    return maxNs;
+}
+
+void PhaseStatistics::clear()
+{
+    memset(histograms, 0, sizeof(histograms));
+}
+
+void PhaseStatistics::merge(const PhaseStatistics& stats)
+{
+    for (size_t p = 0; p < static_cast<size_t>(Phase::total); p++)
+        histograms[p].merge(stats.histograms[p]);
+}
+
+void PhaseStatistics::print(std::ostream& os) const
+{
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << '\n' << std::left << std::setw(16) << "Phase" << std::right << std::setw(10) << "count"
+       << std::setw(14) << "total ms" << std::setw(12) << "mean us" << std::setw(12) << "p50 us"
+       << std::setw(12) << "p99 us" << std::setw(12) << "p999 us" << std::setw(12) << "max us" << '\n';
+
+    os << std::fixed;
+    for (size_t p = 0; p < static_cast<size_t>(Phase::total); p++)
+    {
+        const Histogram& h = histograms[p];
+        if (h.count == 0)
+            continue;
+
+        os << std::left << std::setw(16) << phaseNames[p] << std::right << std::setw(10) << h.count
+           << std::setprecision(3) << std::setw(14) << h.totalNs / 1e6
+           << std::setw(12) << h.totalNs / 1e3 / h.count
+           << std::setw(12) << h.percentile(0.5) / 1e3
+           << std::setw(12) << h.percentile(0.99) / 1e3
+           << std::setw(12) << h.percentile(0.999) / 1e3
+           << std::setw(12) << h.maxNs / 1e3 << '\n';
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
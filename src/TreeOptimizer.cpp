@@ -0,0 +1,146 @@
+/**
+ * @file TreeOptimizer.cpp
+ * @brief Optimization passes over a parsed operand/operator/operand binary tree. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-02-09
+ */
+
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "ArithmeticEvaluator.h"
+#include "TreeOptimizer.h"
+
+// Post-order, with a Tree iterator (any depth): whether each subtree is constant is pushed on vConstants on leaving it,
+// and popped by its operator. Both sides are folded, even if the other one is not constant.
+size_t TreeOptimizer::foldConstants()
+{
+    size_t removedBefore = removedNodes;
+    if (pTree == nullptr)
+        return 0;
+
+    std::vector<bool> vConstants;
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTree->getRoot()); it.next(); )
+    {
+        Node<OperationItem>* pNode = it.getNode();
+        OperationId id = pNode->getData().id;
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter)
+        {
+            if (id == OperationId::number || id == OperationId::variable)
+            {
+                vConstants.push_back(id == OperationId::number);
+                it.skipChildren();
+            }
+        }
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::leave && !it.isSkipped())
+        {
+            bool constant = true; // a missing operand evaluates to 0.
+            if (pNode->getRight() != nullptr)
+            {
+                constant = vConstants.back();
+                vConstants.pop_back();
+            }
+            if (pNode->getLeft() != nullptr)
+            {
+                constant = constant && vConstants.back();
+                vConstants.pop_back();
+            }
+
+            if (constant)
+                foldNode(pNode);
+
+            vConstants.push_back(constant);
+        }
+    }
+
+    return removedNodes - removedBefore;
+}
+
+// Collapses the operator pNode, whose operands are constant, into a number.
+void TreeOptimizer::foldNode(Node<OperationItem>* pNode)
+{
+    OperationId id = pNode->getData().id;
+    Node<OperationItem>* pLeft = pNode->getLeft();
+    Node<OperationItem>* pRight = pNode->getRight();
+    OperationItem folded(OperationId::number);
+    folded.value = ArithmeticEvaluator::operate(id,  // the very same arithmetic than at evaluation time.
+                                                pLeft ? pLeft->getData().value : 0.0,
+                                                pRight ? pRight->getData().value : 0.0);
+    pNode->setData(folded);
+    pNode->setLeft(nullptr);
+    pNode->setRight(nullptr);
+    releaseSubtree(pLeft);
+    releaseSubtree(pRight);
+}
+
+// Hash-consing, bottom up: once the children of a node are unique, the node is unique too unless an
+// identical one (same item, same children) was already found. Then, the duplicate is released and its
+// parent refers to the first one, which keeps its owner (pParent) and gets marked as shared.
+// Post-order, with a Tree iterator (any depth); a duplicate is never both operands of its parent, as
+// the first edge to a node makes it unique.
+size_t TreeOptimizer::shareSubexpressions()
+{
+    size_t removedBefore = removedNodes;
+    if (pTree == nullptr)
+        return 0;
+
+    UniqueNodes uniqueNodes;
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTree->getRoot()); it.next(); )
+    {
+        if (it.getStep() != Tree<OperationItem>::Iterator::Step::leave)
+            continue;
+
+        Node<OperationItem>* pNode = it.getNode();
+        const OperationItem& item = pNode->getData();
+        SubtreeKey key = {item.id, 0, pNode->getLeft(), pNode->getRight()};
+        if (item.id == OperationId::number || item.id == OperationId::variable) // operators do not use value.
+            memcpy(&key.valueBits, &item.value, sizeof(key.valueBits)); // so -0 and 0 are not merged.
+
+        auto inserted = uniqueNodes.emplace(key, pNode);
+        Node<OperationItem>* pUnique = inserted.first->second;
+        if (pUnique == pNode) // the first one found, or an already shared node reached again.
+            continue;
+
+        Node<OperationItem>* pFrom = it.getFrom(); // not null, the top node is the first one found.
+        if (pFrom->getLeft() == pNode)
+            pFrom->setLeft(pUnique);
+        else
+            pFrom->setRight(pUnique);
+
+        pUnique->setShared(true);
+        pFactory->destroyNode(pNode); // its children, if any, are the ones of pUnique, owned by others.
+        removedNodes++;
+    }
+
+    return removedNodes - removedBefore;
+}
+
+size_t TreeOptimizer::SubtreeKeyHash::operator () (const SubtreeKey& k) const
+{
+    size_t h = std::hash<uint64_t>()(k.valueBits) ^ static_cast<size_t>(k.id);
+    h = h * 31 + std::hash<const void*>()(k.pLeft);
+    return h * 31 + std::hash<const void*>()(k.pRight);
+}
+
+// Only the owned nodes are released, a shared one is still referred from elsewhere (on a DAG
+// foldConstants() should have been run before shareSubexpressions(), then nothing is left behind).
+// Post-order, with a Tree iterator, along the owning edges only.
+void TreeOptimizer::releaseSubtree(Node<OperationItem>* pTop)
+{
+    Tree<OperationItem>::Iterator it;
+    for (it.start(pTop); it.next(); )
+    {
+        Node<OperationItem>* pNode = it.getNode();
+        Node<OperationItem>* pFrom = it.getFrom();
+        bool owned = !pNode->isShared() && (pFrom == nullptr || pNode->getParent() == pFrom);
+        if (it.getStep() == Tree<OperationItem>::Iterator::Step::enter && !owned)
+            it.skipChildren();
+        else if (it.getStep() == Tree<OperationItem>::Iterator::Step::leave && owned)
+        {
+            pFactory->destroyNode(pNode); // a no-op in arena mode, the whole arena is reset with the tree.
+            removedNodes++;
+        }
+    }
+}
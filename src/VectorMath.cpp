@@ -0,0 +1,663 @@
+/**
+ * @file VectorMath.cpp
+ * @brief Vectorized kernels of the built-in functions, over arrays of doubles, dispatched at run time
+ *        to the widest SIMD instruction set of the CPU. Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-04-05
+ */
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "ArithmeticEvaluator.h"
+#include "VectorMath.h"
+
+// Built once per instruction set, and resolved once (GNU ifunc) to the widest one of the running CPU.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VECTOR_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_KERNEL
+#endif
+
+static const double roundingMagic = 0x1.8p52; // x + it - it rounds x to an integer, kept in the low bits too.
+static const uint64_t signMask = 0x8000000000000000ull;
+
+static const double ln2Hi = 0x1.62e42feep-1; // ln(2) in two parts, the first one exact times an exponent.
+static const double ln2Lo = 0x1.a39ef35793c76p-33;
+static const double invLn2 = 0x1.71547652b82fep+0;
+
+using Precision = VectorMath::Precision;
+
+// 1/n!, the Taylor coefficients of exp, sin, cos, sinh and cosh.
+static constexpr double inverseFactorials[] =
+{
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320, 1.0 / 362880,
+    1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800, 1.0 / 87178291200, 1.0 / 1307674368000,
+    1.0 / 20922789888000, 1.0 / 355687428096000, 1.0 / 6402373705728000, 1.0 / 121645100408832000
+};
+
+// 1/First! + z/(First + Step)! + z^2/(First + 2*Step)! + ... + z^n/Last!, by Horner; unrolled, the bounds are
+// constant.
+template<int First, int Step, int Last>
+static inline double factorialSeries(double z)
+{
+    double p = inverseFactorials[Last];
+    for (int n = Last - Step; n >= First; n -= Step)
+        p = p * z + inverseFactorials[n];
+    return p;
+}
+
+// The last term of a series, for the low, medium and high precisions: the first one dropped is below their error.
+static constexpr int lastTerm(Precision precision, int low, int medium, int high)
+{
+    return precision == Precision::low ? low : precision == Precision::medium ? medium : high;
+}
+
+// The lanes of a loop, as the values of a scalar code: the bit casts are free, and the selects blends.
+static inline uint64_t toBits(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+static inline double fromBits(uint64_t bits)
+{
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+static inline double copySign(double magnitude, double sign)
+{
+    return fromBits((toBits(magnitude) & ~signMask) | (toBits(sign) & signMask));
+}
+
+static inline double twoToThe(uint64_t integerBits) // 2^k, k in the low bits of k + roundingMagic.
+{
+    return fromBits((integerBits + 1023) << 52);
+}
+
+// fdlibm exp(): x = k*ln(2) + r, |r| <= ln(2)/2, a Remez polynomial (a Taylor one below the full precision),
+// then the exponent adds k. |x| <= 708.
+template<Precision P>
+static inline double expCore(double x)
+{
+    const double p1 = 1.66666666666666019037e-01, p2 = -2.77777777770155933842e-03, p3 = 6.61375632143793436117e-05,
+                 p4 = -1.65339022054652515390e-06, p5 = 4.13813679705723846039e-08;
+
+    double t = x * invLn2 + roundingMagic;
+    double k = t - roundingMagic;
+    double hi = x - k * ln2Hi;
+    double lo = k * ln2Lo;
+    double r = hi - lo;
+    double y = 0;
+    if constexpr (P == Precision::full)
+    {
+        double z = r * r;
+        double c = r - z * (p1 + z * (p2 + z * (p3 + z * (p4 + z * p5))));
+        y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+    }
+    else
+        y = factorialSeries<0, 1, lastTerm(P, 4, 7, 10)>(r);
+    return fromBits(toBits(y) + (toBits(t) << 52));
+}
+
+// exp(x) - 1 without cancellation: 2^k * expm1(r) + (2^k - 1), a Taylor polynomial for expm1(r). |x| <= 708.
+template<Precision P>
+static inline double expm1Core(double x)
+{
+    double t = x * invLn2 + roundingMagic;
+    double k = t - roundingMagic;
+    double hi = x - k * ln2Hi;
+    double lo = k * ln2Lo;
+    double r = hi - lo;
+    double c = (hi - r) - lo; // what r lost.
+    double p = r * r * factorialSeries<2, 1, P == Precision::full ? 14 : lastTerm(P, 5, 7, 10)>(r);
+    double em = r + (p + c * (1.0 + r));
+    double scale = twoToThe(toBits(t));
+    return scale * em + (scale - 1.0);
+}
+
+// x = 2^k * (1 + f), 1 + f in [sqrt(2)/2, sqrt(2)); f is exact. x a positive normal number.
+static inline double splitLog(double x, double& k)
+{
+    uint64_t bits = toBits(x) + (0x3ff0000000000000ull - 0x3fe6a09e00000000ull);
+    uint64_t exponent = bits >> 52;
+    k = fromBits(0x4330000000000000ull | exponent) - (0x1p52 + 1023.0);
+    return fromBits((bits & 0x000fffffffffffffull) + 0x3fe6a09e00000000ull) - 1.0;
+}
+
+// musl log(): ln(1 + f) = f - hfsq + s*(hfsq + R(s^2)), s = f/(2 + f). The parts are combined by every logarithm.
+static inline void logParts(double x, double& k, double& f, double& hfsq, double& sR)
+{
+    const double lg1 = 6.666666666666735130e-01, lg2 = 3.999999999940941908e-01, lg3 = 2.857142874366239149e-01,
+                 lg4 = 2.222219843214978396e-01, lg5 = 1.818357216161805012e-01, lg6 = 1.531383769920937332e-01,
+                 lg7 = 1.479819860511658591e-01;
+
+    f = splitLog(x, k);
+    hfsq = 0.5 * f * f;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double w = z * z;
+    double t1 = w * (lg2 + w * (lg4 + w * lg6));
+    double t2 = z * (lg1 + w * (lg3 + w * (lg5 + w * lg7)));
+    sR = s * (hfsq + t1 + t2);
+}
+
+// Below the full precision, ln(1 + f) = 2*atanh(s) = 2s + 2s^3/3 + 2s^5/5 + ..., |s| < 0.172.
+template<Precision P>
+static inline double log1pSeries(double f)
+{
+    const int lastOdd = 2 * lastTerm(P, 2, 4, 6) + 1;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double p = 1.0 / lastOdd;
+    for (int n = lastOdd - 2; n >= 3; n -= 2)
+        p = p * z + 1.0 / n;
+    return 2.0 * s + 2.0 * s * z * p;
+}
+
+template<Precision P>
+static inline double logCore(double x)
+{
+    double k = 0;
+    if constexpr (P == Precision::full)
+    {
+        double f = 0, hfsq = 0, sR = 0;
+        logParts(x, k, f, hfsq, sR);
+        return sR + k * ln2Lo - hfsq + f + k * ln2Hi;
+    }
+    else
+    {
+        double lf = log1pSeries<P>(splitLog(x, k));
+        return k * ln2Hi + (k * ln2Lo + lf);
+    }
+}
+
+// musl log2() and log10(): f - hfsq split in a 32 bit high part, so that its product is exact.
+template<Precision P>
+static inline double log2Core(double x)
+{
+    const double invLn2Hi = 1.44269504072144627571e+00, invLn2Lo = 1.67517131648865118353e-10;
+
+    if constexpr (P != Precision::full)
+    {
+        double k = 0;
+        double lf = log1pSeries<P>(splitLog(x, k)); // before reading k, which splitLog() writes.
+        return k + lf * invLn2;
+    }
+
+    double k = 0, f = 0, hfsq = 0, sR = 0;
+    logParts(x, k, f, hfsq, sR);
+    double hi = fromBits(toBits(f - hfsq) & 0xffffffff00000000ull);
+    double lo = f - hi - hfsq + sR;
+    double valueHi = hi * invLn2Hi;
+    double valueLo = (lo + hi) * invLn2Lo + lo * invLn2Hi;
+    double w = k + valueHi;
+    valueLo += (k - w) + valueHi;
+    return valueLo + w;
+}
+
+template<Precision P>
+static inline double log10Core(double x)
+{
+    const double invLn10Hi = 4.34294481878168880939e-01, invLn10Lo = 2.50829467116452752298e-11,
+                 log10Of2Hi = 3.01029995663611771306e-01, log10Of2Lo = 3.69423907715893078616e-13;
+
+    if constexpr (P != Precision::full)
+    {
+        double k = 0;
+        double lf = log1pSeries<P>(splitLog(x, k));
+        return k * log10Of2Hi + (k * log10Of2Lo + lf * (invLn10Hi + invLn10Lo));
+    }
+
+    double k = 0, f = 0, hfsq = 0, sR = 0;
+    logParts(x, k, f, hfsq, sR);
+    double hi = fromBits(toBits(f - hfsq) & 0xffffffff00000000ull);
+    double lo = f - hi - hfsq + sR;
+    double valueHi = hi * invLn10Hi;
+    double y = k * log10Of2Hi;
+    double valueLo = k * log10Of2Lo + (lo + hi) * invLn10Lo + lo * invLn10Hi;
+    double w = y + valueHi;
+    valueLo += (y - w) + valueHi;
+    return valueLo + w;
+}
+
+// ln(1 + u), u >= 0: Kahan's ln(w) * u / (w - 1), w = 1 + u, which cancels the rounding of w.
+template<Precision P>
+static inline double log1pCore(double u)
+{
+    double w = 1.0 + u;
+    double ratio = u / (w - 1.0);
+    return w == 1.0 ? u : logCore<P>(w) * ratio;
+}
+
+// x = k*pi/2 + (hi + lo): pi/2 in three parts, the first two of 33 bits so that k times them is exact, and the
+// remainder kept as a double-double. Exact for |x| <= 10^6 (k < 2^20); quadrant gets k in its low bits.
+static inline double reduceHalfPi(double x, double& lo, uint64_t& quadrant)
+{
+    const double pio2_1 = 0x1.921fb544p+0, pio2_2 = 0x1.0b4611a6p-34, pio2_2t = 0x1.3198a2e037073p-69,
+                 twoOverPi = 0x1.45f306dc9c883p-1;
+
+    double t = x * twoOverPi + roundingMagic;
+    double k = t - roundingMagic;
+    quadrant = toBits(t);
+    double r1 = x - k * pio2_1;
+    double w = k * pio2_2;
+    double hi = r1 - w;
+    double b = hi - r1;
+    double e = (r1 - (hi - b)) + (-w - b); // Knuth's two-sum: hi + e is exactly r1 - w.
+    e -= k * pio2_2t;
+    double sum = hi + e;
+    b = sum - hi;
+    lo = (hi - (sum - b)) + (e - b);
+    return sum;
+}
+
+// fdlibm __kernel_sin() and __kernel_cos(), over x + y, |x| <= pi/4.
+static inline double sinKernel(double x, double y)
+{
+    const double s1 = -1.66666666666666324348e-01, s2 = 8.33333333332248946124e-03, s3 = -1.98412698298579493134e-04,
+                 s4 = 2.75573137070700676789e-06, s5 = -2.50507602534068634195e-08, s6 = 1.58969099521155010221e-10;
+
+    double z = x * x;
+    double v = z * x;
+    double r = s2 + z * (s3 + z * (s4 + z * (s5 + z * s6)));
+    return x - ((z * (0.5 * y - v * r) - y) - v * s1);
+}
+
+static inline double cosKernel(double x, double y)
+{
+    const double c1 = 4.16666666666666019037e-02, c2 = -1.38888888888741095749e-03, c3 = 2.48015872894767294178e-05,
+                 c4 = -2.75573143513906633035e-07, c5 = 2.08757232129817482790e-09, c6 = -1.13596475577881948265e-11;
+
+    double z = x * x;
+    double r = z * (c1 + z * (c2 + z * (c3 + z * (c4 + z * (c5 + z * c6)))));
+    double absX = fromBits(toBits(x) & ~signMask);
+    double qx = fromBits((toBits(absX) - (2ull << 52)) & 0xffffffff00000000ull); // about x/4, exactly 1 - qx.
+    qx = (absX < 0.3 ? 0.0 : absX > 0.78125 ? 0.28125 : qx);
+    double hz = 0.5 * z - qx;
+    double a = 1.0 - qx;
+    return a - (hz - (z * r - x * y));
+}
+
+// The arguments of sin, cos and tan, reduced: s = sin(r), c = cos(r), the quadrant in the low bits of q.
+// Below the full precision, the Taylor series over -r^2 (hi alone, lo is beyond their error).
+template<Precision P>
+static inline void sinCos(double x, double& s, double& c, uint64_t& q)
+{
+    double lo = 0;
+    double hi = reduceHalfPi(x, lo, q);
+    bool small = fromBits(toBits(x) & ~signMask) <= 0x1.921fb54442d18p-1; // no reduction (and sin(-0) = -0).
+    hi = (small ? x : hi);
+    lo = (small ? 0.0 : lo);
+    q = (small ? 0 : q);
+    if constexpr (P == Precision::full)
+    {
+        s = sinKernel(hi, lo);
+        c = cosKernel(hi, lo);
+    }
+    else
+    {
+        double z = -hi * hi;
+        s = hi * factorialSeries<1, 2, lastTerm(P, 5, 9, 13)>(z);
+        c = factorialSeries<0, 2, lastTerm(P, 6, 8, 12)>(z);
+    }
+}
+
+// Cephes atan(): atan(x) = pi/2 - atan(1/x) over tan(3*pi/8), pi/4 + atan((x - 1)/(x + 1)) over 0.66,
+// then a rational function.
+static inline double atanCore(double x)
+{
+    const double p0 = -8.750608600031904122785e-01, p1 = -1.615753718733365076637e+01,
+                 p2 = -7.500855792314704667340e+01, p3 = -1.228866684490136173410e+02,
+                 p4 = -6.485021904942025371773e+01;
+    const double q0 = 2.485846490142306297962e+01, q1 = 1.650270098316988542046e+02,
+                 q2 = 4.328810604912902668951e+02, q3 = 4.853903996359136964868e+02,
+                 q4 = 1.945506571482613964425e+02;
+    const double tan3PiOver8 = 2.41421356237309504880, moreBits = 6.123233995736765886130e-17;
+
+    double a = fromBits(toBits(x) & ~signMask);
+    bool large = a > tan3PiOver8;
+    bool middle = !large && a > 0.66;
+    double inverse = -1.0 / a;
+    double shifted = (a - 1.0) / (a + 1.0);
+    double base = (large ? 0x1.921fb54442d18p+0 : middle ? 0x1.921fb54442d18p-1 : 0.0);
+    double extra = (large ? moreBits : middle ? 0.5 * moreBits : 0.0);
+    a = (large ? inverse : middle ? shifted : a);
+    double z = a * a;
+    double p = (((p0 * z + p1) * z + p2) * z + p3) * z + p4;
+    double q = ((((z + q0) * z + q1) * z + q2) * z + q3) * z + q4;
+    double y = base + ((a * (z * p / q) + a) + extra);
+    return copySign(y, x);
+}
+
+// Cephes gamma(): brought to [2, 3) by Gamma(x + 1) = x * Gamma(x), then a rational function. 0 < x <= 10.
+static inline double gammaCore(double x)
+{
+    const double p[7] =
+    {
+        1.60119522476751861407e-04, 1.19135147006586384913e-03, 1.04213797561761569935e-02,
+        4.76367800457137231464e-02, 2.07448227648435975150e-01, 4.94214826801497100753e-01,
+        9.99999999999999996796e-01
+    };
+    const double q[8] =
+    {
+        -2.31581873324120129819e-05, 5.39605580493303397842e-04, -4.45641913851797240494e-03,
+        1.18139785222060435552e-02, 3.58236398605498653373e-02, -2.34591795718243348568e-01,
+        7.14304917030273074085e-02, 1.00000000000000000320e+00
+    };
+
+    double z = 1.0;
+    for (int i = 0; i < 8; i++)
+    {
+        bool down = x >= 3.0;
+        double lower = x - 1.0;
+        double product = z * lower;
+        x = (down ? lower : x);
+        z = (down ? product : z);
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        bool up = x < 2.0;
+        double quotient = z / x;
+        double upper = x + 1.0;
+        z = (up ? quotient : z);
+        x = (up ? upper : x);
+    }
+
+    x -= 2.0;
+    double numerator = p[0], denominator = q[0];
+    for (int i = 1; i < 7; i++)
+        numerator = numerator * x + p[i];
+    for (int i = 1; i < 8; i++)
+        denominator = denominator * x + q[i];
+    return z * numerator / denominator;
+}
+
+// The kernels: one loop each, whose body the compiler turns into SIMD code of the clone's instruction set.
+template<Precision P>
+VECTOR_KERNEL static void sinKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double s = 0, c = 0;
+        uint64_t q = 0;
+        sinCos<P>(x[i], s, c, q);
+        double v = (q & 1 ? c : s);
+        y[i] = (q & 2 ? -v : v);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void cosKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double s = 0, c = 0;
+        uint64_t q = 0;
+        sinCos<P>(x[i], s, c, q);
+        double v = (q & 1 ? s : c);
+        y[i] = ((q + 1) & 2 ? -v : v);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void tanKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double s = 0, c = 0;
+        uint64_t q = 0;
+        sinCos<P>(x[i], s, c, q);
+        double even = s / c;
+        double odd = -c / s;
+        y[i] = (q & 1 ? odd : even);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void sinhKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        double z = a * a;
+        double series = a + a * z * factorialSeries<3, 2, P == Precision::full ? 19 : lastTerm(P, 7, 9, 13)>(z);
+        double e = expCore<P>(a);
+        double exponentials = 0.5 * e - 0.5 / e;
+        y[i] = copySign(a < 1.0 ? series : exponentials, x[i]);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void coshKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        double z = a * a;
+        double series = 1.0 + z * factorialSeries<2, 2, P == Precision::full ? 18 : lastTerm(P, 6, 10, 14)>(z);
+        double e = expCore<P>(a);
+        double exponentials = 0.5 * e + 0.5 / e;
+        y[i] = (a < 1.0 ? series : exponentials);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void tanhKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        double t = expm1Core<P>(2.0 * (a < 22.0 ? a : 22.0));
+        double v = t / (t + 2.0);
+        y[i] = copySign(a < 22.0 ? v : 1.0, x[i]);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void expKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = expCore<P>(x[i]);
+}
+
+VECTOR_KERNEL static void asinKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        y[i] = copySign(atanCore(a / sqrt((1.0 - a) * (1.0 + a))), x[i]);
+    }
+}
+
+VECTOR_KERNEL static void acosKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = 2.0 * atanCore(sqrt((1.0 - x[i]) / (1.0 + x[i])));
+}
+
+VECTOR_KERNEL static void atanKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = atanCore(x[i]);
+}
+
+template<Precision P>
+VECTOR_KERNEL static void asinhKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        double z = a * a;
+        y[i] = copySign(log1pCore<P>(a + z / (1.0 + sqrt(1.0 + z))), x[i]);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void acoshKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double below = x[i] - 1.0;
+        y[i] = log1pCore<P>(below + sqrt(below * (x[i] + 1.0)));
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void atanhKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        y[i] = copySign(0.5 * log1pCore<P>(2.0 * a / (1.0 - a)), x[i]);
+    }
+}
+
+template<Precision P>
+VECTOR_KERNEL static void lnKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = logCore<P>(x[i]);
+}
+
+template<Precision P>
+VECTOR_KERNEL static void log10Kernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = log10Core<P>(x[i]);
+}
+
+template<Precision P>
+VECTOR_KERNEL static void log2Kernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = log2Core<P>(x[i]);
+}
+
+VECTOR_KERNEL static void sqrtKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = sqrt(x[i]); // a single instruction, as VectorMath.o is built without errno.
+}
+
+// A true cube root (not the exp(ln(x)/3) of ArithmeticEvaluator): exp(ln(|x|)/3) rounded to 22 bits, so that
+// its square is exact, then one fdlibm cbrt() step, of third order: from the low precision below the full one.
+template<Precision P>
+VECTOR_KERNEL static void cubrootKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = fromBits(toBits(x[i]) & ~signMask);
+        const Precision guess = (P == Precision::full ? Precision::full : Precision::low);
+        double t = expCore<guess>(logCore<guess>(a) / 3.0);
+        t = fromBits((toBits(t) + 0x80000000ull) & 0xffffffffc0000000ull);
+        double r = a / (t * t);
+        r = (r - t) / (t + t + r);
+        y[i] = copySign(t + t * r, x[i]);
+    }
+}
+
+VECTOR_KERNEL static void gammaKernels(const double* x, double* y, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        y[i] = gammaCore(x[i]);
+}
+
+// The instances of a kernel at every precision, or the same one (exact, or a rational function kept).
+#define PRECISIONS(kernels) \
+    {kernels<Precision::low>, kernels<Precision::medium>, kernels<Precision::high>, kernels<Precision::full>}
+#define ONE_PRECISION(kernels) {kernels, kernels, kernels, kernels}
+
+// In OperationId order, from sin to gama.
+const VectorMath::Domain VectorMath::domains[] =
+{
+    {PRECISIONS(sinKernels),        true,  0.0,     1e6,                     1},
+    {PRECISIONS(cosKernels),        true,  0.0,     1e6,                     1},
+    {PRECISIONS(tanKernels),        true,  0.0,     1e6,                     2.5},
+    {PRECISIONS(sinhKernels),       true,  0.0,     708,                     2},
+    {PRECISIONS(coshKernels),       true,  0.0,     708,                     2},
+    {PRECISIONS(tanhKernels),       true,  0.0,     HUGE_VAL,                2.5},
+    {PRECISIONS(expKernels),        true,  0.0,     708,                     1},
+    {ONE_PRECISION(asinKernels),    true,  0.0,     1.0,                     3},
+    {ONE_PRECISION(acosKernels),    true,  0.0,     1.0,                     2},
+    {ONE_PRECISION(atanKernels),    true,  0.0,     HUGE_VAL,                1},
+    {PRECISIONS(asinhKernels),      true,  0.0,     1e150,                   3},
+    {PRECISIONS(acoshKernels),      false, 1.0,     1e150,                   3},
+    {PRECISIONS(atanhKernels),      true,  0.0,     0x1.fffffffffffffp-1,    3},
+    {PRECISIONS(lnKernels),         false, DBL_MIN, DBL_MAX,                 1},
+    {PRECISIONS(log10Kernels),      false, DBL_MIN, DBL_MAX,                 1},
+    {PRECISIONS(log2Kernels),       false, DBL_MIN, DBL_MAX,                 1},
+    {ONE_PRECISION(sqrtKernels),    false, 0.0,     HUGE_VAL,                0.5},
+    {PRECISIONS(cubrootKernels),    true,  DBL_MIN, DBL_MAX,                 1},
+    {ONE_PRECISION(gammaKernels),   false, DBL_MIN, 10.0,                    6}
+};
+
+// Relative, the worst of all the functions at each precision, measured as getMaxUlpError() (2^-52 per ULP at
+// worst for the full one) and rounded up.
+const double VectorMath::maxErrors[] = {1e-4, 1e-7, 1e-11, 1.4e-15};
+
+// The values of a block outside a domain, NaN too: counted first, without branches; usually none.
+VECTOR_KERNEL static size_t countOutside(const double* x, size_t count, bool symmetric, double low, double high)
+{
+    size_t outside = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double value = (symmetric ? fabs(x[i]) : x[i]);
+        outside += !(low <= value && value <= high);
+    }
+    return outside;
+}
+
+void VectorMath::evaluate(OperationId id, const double* x, double* y, size_t count, Precision precision)
+{
+    const Domain& domain = domains[static_cast<size_t>(id) - static_cast<size_t>(OperationId::firstFunction)];
+    Kernel kernel = domain.kernels[static_cast<size_t>(precision)];
+    double block[blockSize];
+    for (size_t first = 0; first < count; first += blockSize)
+    {
+        size_t n = (count - first < blockSize ? count - first : blockSize);
+        memcpy(block, x + first, n * sizeof(double));
+        kernel(block, y + first, n);
+        size_t outside = countOutside(block, n, domain.symmetric, domain.low, domain.high);
+        for (size_t i = 0; outside > 0 && i < n; i++)
+        {
+            double value = (domain.symmetric ? fabs(block[i]) : block[i]);
+            if (!(domain.low <= value && value <= domain.high))
+                y[first + i] = ArithmeticEvaluator::operate(id, 0.0, block[i]);
+        }
+    }
+}
+
+double VectorMath::getMaxUlpError(OperationId id)
+{
+    return domains[static_cast<size_t>(id) - static_cast<size_t>(OperationId::firstFunction)].maxUlpError;
+}
+
+double VectorMath::getMaxError(Precision precision)
+{
+    return maxErrors[static_cast<size_t>(precision)];
+}
+
+VectorMath::Precision VectorMath::choosePrecision(double maxError)
+{
+    int precision = static_cast<int>(Precision::low);
+    while (precision < static_cast<int>(Precision::full) && !(maxErrors[precision] <= maxError))
+        precision++;
+    return static_cast<Precision>(precision);
+}
+
+const char* VectorMath::getInstructionSet()
+{
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512f";
+    else if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+#endif
+    return "sse2";
+}
@@ -0,0 +1,137 @@
+/**
+ * @file WorkStealingPool.cpp
+ * @brief Fixed set of worker threads running indexed batches of independent tasks.
+ *        Implementation file.
+ * @author Guillermo M. Paris
+ * @date 2020-01-12
+ */
+
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned workers)
+    : vRanges(workers > 0 ? workers : 1)
+    , generation(0)
+    , pending(0)
+    , stopping(false)
+{
+    for (Range& r : vRanges)
+        r.begin = r.end = 0;
+
+    for (unsigned w = 0; w < vRanges.size(); w++)
+        vWorkers.emplace_back(&WorkStealingPool::workerLoop, this, w);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cvStart.notify_all();
+
+    for (std::thread& t : vWorkers)
+        t.join();
+}
+
+unsigned WorkStealingPool::defaultWorkerCount()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+void WorkStealingPool::start(size_t count, Task newTask)
+{
+    wait(); // never overlap two batches.
+    if (count == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    task = std::move(newTask);
+    pending = count;
+
+    size_t n = vRanges.size();
+    for (size_t w = 0; w < n; w++) // initial even split, later balanced by stealing.
+    {
+        std::lock_guard<std::mutex> rangeLock(vRanges[w].mtx);
+        vRanges[w].begin = count * w / n;
+        vRanges[w].end = count * (w + 1) / n;
+    }
+
+    generation++;
+    cvStart.notify_all();
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cvDone.wait(lock, [this] () {return pending == 0;});
+}
+
+void WorkStealingPool::workerLoop(unsigned worker)
+{
+    unsigned seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cvStart.wait(lock, [this, seen] () {return stopping || generation != seen;});
+            if (stopping)
+                return;
+
+            seen = generation;
+        }
+
+        size_t index = 0;
+        while (popOwn(worker, index) || steal(worker, index))
+        {
+            task(index, worker);
+            if (--pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                cvDone.notify_all();
+            }
+        }
+    }
+}
+
+bool WorkStealingPool::popOwn(unsigned worker, size_t& index)
+{
+    Range& own = vRanges[worker];
+    std::lock_guard<std::mutex> lock(own.mtx);
+    if (own.begin == own.end)
+        return false;
+
+    index = own.begin++;
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned thief, size_t& index)
+{
+    Range& own = vRanges[thief];
+    size_t n = vRanges.size();
+    for (size_t k = 1; k < n; k++)
+    {
+        Range& victim = vRanges[(thief + k) % n];
+        std::unique_lock<std::mutex> ownLock(own.mtx, std::defer_lock);
+        std::unique_lock<std::mutex> victimLock(victim.mtx, std::defer_lock);
+        std::lock(ownLock, victimLock); // both at once, so no new batch can slip in between.
+
+        if (own.begin != own.end) // refilled meanwhile by a new batch.
+        {
+            index = own.begin++;
+            return true;
+        }
+
+        if (victim.begin == victim.end)
+            continue;
+
+        size_t middle = victim.begin + (victim.end - victim.begin) / 2; // take the back half.
+        index = middle;
+        own.begin = middle + 1;
+        own.end = victim.end;
+        victim.end = middle;
+        return true;
+    }
+
+    return false;
+}
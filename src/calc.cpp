@@ -5,108 +5,627 @@
  * @date 2019-10-27
  */
 
+#include <condition_variable>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
 #include "NodeFactory.h"
 #include "ArithmeticEvaluator.h"
+#include "CompiledExpression.h"
+#include "ExpressionCache.h"
 #include "ExpressionParser.h"
+#include "JitExpression.h"
+#include "LineReader.h"
 #include "OperationItem.h"
-
-template <> NodeFactory<OperationItem>* NodeFactory<OperationItem>::pInstance(nullptr);
+#include "PhaseStatistics.h"
+#include "TreeOptimizer.h"
+#include "VectorMath.h"
+#include "WorkStealingPool.h"
 
 const char* szTitle1 = "==============================";
 const char* szTitle2 = " Expression #";
 const char* szTitle3 = "==================";
 
-int main (int argc, char* argv[])
+const size_t linesPerBlock = 4096; // lines read (and evaluated) at once from a file or stdin.
+const size_t pointsPerBlock = 4096; // grid points evaluated at once by a tabulation.
+const size_t defaultCacheEntries = 65536; // of the expression cache, when -c is given without a size.
+
+using Factory = NodeFactory<OperationItem>;
+using Line = LineReader::Line;
+
+struct GridVariable // name=start:end:step
 {
-    if (argc < 2 ||  (argc < 3 && argv[1][0] == '-' && argv[1][1] == 'v'))
+    double start;
+    double step;
+    size_t count;
+};
+
+struct BatchContext
+{
+    ExpressionParser::Verbosity            verbosity;
+    ExpressionParser::Engine               engine; // of the tree building.
+    bool                                   jit; // tabulations run as machine code.
+    bool                                   fusedMultiplyAdd; // and that code may fuse a*b+c.
+    bool                                   vectorMath; // tabulated functions by the SIMD kernels,
+    VectorMath::Precision                  precision; // at this precision.
+    bool                                   interactive; // -i: an answer per line, without titles.
+    ExpressionParser::VariableNames        variableNames; // the ones of the grid, if any.
+    std::vector<GridVariable>              grid;
+    std::unique_ptr<WorkStealingPool>      pPool; // null for the sequential evaluation.
+    std::unique_ptr<ExpressionCache>       pCache; // null unless -c was given.
+    std::vector<std::unique_ptr<PhaseStatistics>> statistics; // one per worker with -stats, otherwise none.
+    std::vector<std::unique_ptr<Factory>>  factories; // one arena per worker, never shared.
+};
+
+static bool parseGridVariable(const char* pcArg, std::string& name, GridVariable& variable)
+{
+    const char* pcEqual = strchr(pcArg, '=');
+    name.assign(pcArg, pcEqual - pcArg);
+    if (name.empty() || !isalpha(static_cast<unsigned char>(name[0])))
+        return false;
+
+    char* pcNext = nullptr;
+    double end = variable.start = strtod(pcEqual + 1, &pcNext);
+    variable.step = 1;
+    if (pcNext == pcEqual + 1)
+        return false;
+
+    if (*pcNext == ':')
     {
-        std::cout << "Usage: calc [-v[0-3]]  <expression 1> <expression 2> ... <expression n>\n"
-        << "Example: calc -v1 1+1 5-6/2+3*4 '3+4*(2+1*1*(4-(1+1)))-16' 1*2*3*(2-1/3) '(4 + 5 * (7 - 3)) - 2'\n"
-        << std::endl;
-       return EXIT_FAILURE;
+        const char* pcEnd = pcNext + 1;
+        end = strtod(pcEnd, &pcNext);
+        if (pcNext == pcEnd)
+            return false;
+
+        if (*pcNext == ':')
+        {
+            const char* pcStep = pcNext + 1;
+            variable.step = strtod(pcStep, &pcNext);
+            if (pcNext == pcStep || variable.step == 0)
+                return false;
+        }
+    }
+
+    double steps = (end - variable.start) / variable.step;
+    if (*pcNext != '\0' || steps < 0)
+        return false;
+
+    variable.count = static_cast<size_t>(steps * (1 + 1e-12)) + 1; // tolerant to the rounding of the step.
+    return true;
+}
+
+// A non empty run of decimal digits, as the size of -c or -j (so -cos(0), -cosh(1) or -j 1+1 stay expressions).
+static bool isDigits(const char* pcArg)
+{
+    if (*pcArg == '\0')
+        return false;
+
+    for (; *pcArg != '\0'; pcArg++)
+        if (!isdigit(static_cast<unsigned char>(*pcArg)))
+            return false;
+
+    return true;
+}
+
+// Evaluation of the expression over every point of the grid (the last variable varies the fastest),
+// pointsPerBlock points at once through the SIMD batches of CompiledExpression (their functions too, with
+// -simd), or point by point by its machine code with -jit (where it can be generated).
+static void tabulateExpression(const CompiledExpression& program, const BatchContext& context, std::ostream& os)
+{
+    JitExpression jit;
+    if (context.jit)
+        jit.compile(program, context.fusedMultiplyAdd);
+
+    PhaseTimer timer(PhaseStatistics::Phase::tabulation);
+    size_t variableCount = context.grid.size();
+    size_t total = 1;
+    for (size_t v = 0; v < variableCount; v++)
+    {
+        total *= context.grid[v].count;
+        os << context.variableNames[v] << '\t';
+    }
+    os << "Result\n";
+
+    std::vector<std::vector<double>> columns(variableCount, std::vector<double>(pointsPerBlock));
+    std::vector<const double*> arrays(variableCount);
+    std::vector<double> results(pointsPerBlock);
+    std::vector<double> point(variableCount); // of the variables, for the machine code.
+    for (size_t v = 0; v < variableCount; v++)
+        arrays[v] = columns[v].data();
+
+    for (size_t first = 0; first < total; first += pointsPerBlock)
+    {
+        size_t count = (total - first < pointsPerBlock ? total - first : pointsPerBlock);
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t point = first + i;
+            for (size_t v = variableCount; v-- > 0; )
+            {
+                const GridVariable& variable = context.grid[v];
+                columns[v][i] = variable.start + (point % variable.count) * variable.step;
+                point /= variable.count;
+            }
+        }
+
+        if (!jit.isEmpty())
+        {
+            JitExpression::Function function = jit.getFunction();
+            for (size_t i = 0; i < count; i++)
+            {
+                for (size_t v = 0; v < variableCount; v++)
+                    point[v] = columns[v][i];
+                results[i] = function(point.data());
+            }
+        }
+        else
+            program.evaluate(arrays.data(), results.data(), count, context.vectorMath, context.precision);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t v = 0; v < variableCount; v++)
+                os << columns[v][i] << '\t';
+            os << results[i] << '\n';
+        }
+    }
+}
+
+// The output of a successful evaluation without traces, either just computed or found in the cache.
+// Interactively, the result alone, or the table ended by an empty line.
+static void printEntry(const Line& expression, const ExpressionCache::Entry& entry, const BatchContext& context,
+                       std::ostream& os)
+{
+    if (context.grid.empty())
+    {
+        PhaseTimer timer(PhaseStatistics::Phase::output);
+        os << (context.interactive ? "" : "Result = ") << entry.result << '\n';
+        return;
+    }
+
+    if (!context.interactive)
+        os.write(expression.text, expression.length) << '\n';
+    tabulateExpression(*entry.pProgram, context, os);
+    if (context.interactive)
+        os << '\n';
+}
+
+static bool evaluateExpression(const Line& expression, int number, const BatchContext& context,
+                               Factory& factory, std::ostream& os)
+{
+    ExpressionParser::Verbosity verbosity = context.verbosity;
+    if (verbosity == ExpressionParser::Verbosity::none)
+    {
+        if (!context.interactive)
+            os << "\nExpression #" << number <<  " : ";
+    }
+    else
+        os << '\n' << szTitle1 << szTitle2 << number << ' ' << szTitle1 << '\n';
+
+    ExpressionCache* pCache = (verbosity == ExpressionParser::Verbosity::none ? context.pCache.get() : nullptr);
+    ExpressionCache::Entry entry;
+    std::string textKey;
+    if (pCache != nullptr)
+    {
+        textKey = ExpressionCache::normalize(expression.text, expression.length);
+        if (pCache->find(textKey, entry, false)) // a miss is counted on the canonical key, once parsed.
+        {
+            printEntry(expression, entry, context, os);
+            return true;
+        }
+    }
+
+    ExpressionParser parser(expression.text, expression.length, verbosity, factory,
+                            context.grid.empty() ? nullptr : &context.variableNames, context.engine);
+    if (!parser.finishedOK())
+    {
+        char cBad = parser.getFaultyChar();
+        int  pos = parser.getExpressionIndex();
+        int errorCode = parser.getIntError();
+        if (context.interactive) // on a single line too.
+        {
+            os << "ERROR " << errorCode << " at position " << pos << ": " << parser.getLastErrorMessage() << '\n';
+            return false;
+        }
+
+        os << "ERROR " << errorCode << " parsing the expresion:\n";
+        os.write(expression.text, expression.length) << '\n';
+
+        if (cBad != '\0')
+        {
+            os << (pos >= 2 ? std::string(pos, ' ') : "") << "^-----\n"
+               << "At position " << pos << " got character \""
+               << cBad << "\" .\n";
+        }
+
+        os << parser.getLastErrorMessage()
+           << " Ignoring it!\n";
+        return false;
+    }
+    else if (verbosity != ExpressionParser::Verbosity::none)
+        parser << os << std::endl;
+
+    std::string canonicalKey;
+    if (pCache != nullptr) // the same expression, written in another way, may have been seen already.
+    {
+        canonicalKey = ExpressionCache::canonicalForm(parser.getTree());
+        if (pCache->find(canonicalKey, entry))
+        {
+            pCache->insert(textKey, entry);
+            printEntry(expression, entry, context, os);
+            return true;
+        }
+    }
+
+    if (!context.grid.empty())
+    {
+        TreeOptimizer optimizer(parser.getTree(), factory); // once, for the whole grid.
+        size_t folded = optimizer.foldConstants();
+        size_t shared = optimizer.shareSubexpressions();
+        if (verbosity != ExpressionParser::Verbosity::none)
+            os << "Constant folding removed " << folded << " nodes, subexpression sharing "
+               << shared << " nodes.\n";
+
+        entry.result = 0.0;
+        entry.pProgram = std::make_shared<CompiledExpression>(parser.getTree());
+    }
+    else
+    {
+        ArithmeticEvaluator evaluator(parser.getTree());
+        if (!evaluator)
+        {
+            os << "ERROR " << evaluator.getError() << " parsing the expresion: ";
+            os.write(expression.text, expression.length) << " . Ignoring it!\n";
+            return false;
+        }
+
+        entry.result = evaluator.getResult();
+    }
+
+    if (pCache != nullptr)
+    {
+        pCache->insert(canonicalKey, entry);
+        pCache->insert(textKey, entry);
     }
 
+    if (verbosity == ExpressionParser::Verbosity::none)
+    {
+        printEntry(expression, entry, context, os);
+        return true;
+    }
+
+    if (context.grid.empty())
+        os << "Result = " << entry.result << '\n';
+    else
+        tabulateExpression(*entry.pProgram, context, os);
+
+    os << szTitle1 << szTitle3 << szTitle1 << '\n';
+    return true;
+}
+
+// Every expression is evaluated by the pool into its own buffer, while this thread prints them in input order.
+static bool evaluateInParallel(const std::vector<Line>& expressions, int firstNumber, BatchContext& context)
+{
+    size_t count = expressions.size();
+    std::vector<std::string> outputs(count);
+    std::vector<char> succeeded(count, 0);
+    std::vector<char> ready(count, 0); // guarded by readyMutex, as awaited.
+    size_t awaited = 0; // the output the printer waits for.
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+
+    context.pPool->start(count, [&] (size_t i, unsigned worker) {
+        if (!context.statistics.empty())
+            PhaseStatistics::current() = context.statistics[worker].get();
+
+        std::ostringstream os;
+        os.precision(15);
+        succeeded[i] = evaluateExpression(expressions[i], firstNumber + int(i), context,
+                                          *context.factories[worker], os);
+        outputs[i] = os.str();
+
+        bool awaken = false;
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready[i] = 1;
+            awaken = (i == awaited);
+        }
+
+        if (awaken) // the printer sleeps just on this one, the others are printed later.
+            readyCondition.notify_one();
+    });
+
+    bool success = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(readyMutex);
+            awaited = i;
+            readyCondition.wait(lock, [&] {return ready[i] != 0;});
+        }
+
+        std::cout << outputs[i];
+        std::string().swap(outputs[i]); // printed, so its memory is no longer needed.
+        success = success && succeeded[i];
+    }
+
+    context.pPool->wait();
+    return success;
+}
+
+static bool evaluateLines(const std::vector<Line>& expressions, int firstNumber, BatchContext& context)
+{
+    if (context.pPool)
+        return evaluateInParallel(expressions, firstNumber, context);
+
+    bool success = true;
+    for (size_t i = 0; i < expressions.size(); i++)
+        if (! evaluateExpression(expressions[i], firstNumber + int(i), context,
+                                 *context.factories[0], std::cout))
+            success = false;
+
+    return success;
+}
+
+// The coprocess mode: every line of the standard input is answered as soon as it is read, and flushed, by this
+// same process; so the factory, the cache and the tables of the functions stay warm from one line to the next.
+static bool evaluateInteractively(int& number, BatchContext& context)
+{
+    LineReader reader;
+    reader.open("-", true); // the empty lines too, every line gets its answer.
+    bool success = true;
+    std::vector<Line> lines;
+    while (reader.readLines(lines, 1) > 0) // returns as soon as a whole line is there.
+    {
+        if (! evaluateExpression(lines[0], number++, context, *context.factories[0], std::cout))
+            success = false;
+
+        std::cout.flush();
+    }
+
+    return success;
+}
+
+static bool evaluateInput(const char* path, int& number, BatchContext& context)
+{
+    LineReader reader;
+    if (!reader.open(path))
+    {
+        std::cout << "\nERROR opening the input file: " << path << '\n';
+        return false;
+    }
+
+    bool success = true;
+    std::vector<Line> lines;
+    while (reader.readLines(lines, linesPerBlock) > 0) // a block at a time, so memory stays constant.
+    {
+        if (! evaluateLines(lines, number, context))
+            success = false;
+
+        number += int(lines.size());
+    }
+
+    return success;
+}
+
+int main (int argc, char* argv[])
+{
     int index = 1;
-    ExpressionParser::Verbosity verbosity = ExpressionParser::Verbosity::none;
+    unsigned workers = 1;
+    std::vector<const char*> inputFiles;
+    BatchContext context;
+    context.verbosity = ExpressionParser::Verbosity::none;
+    context.engine = ExpressionParser::Engine::treeClimbing;
+    context.jit = context.fusedMultiplyAdd = context.vectorMath = false;
+    context.precision = VectorMath::Precision::full;
+    context.interactive = false;
+    double maxError = 0; // asked by -precision.
 
-    if (argv[1] && argv[1][0] == '-')
+    for (; index < argc && argv[index][0] == '-'; index++)
     {
-        int arg1Len = strlen(argv[1]);
-        if (arg1Len > 1 && argv[1][1] == 'v')
+        int argLen = strlen(argv[index]);
+        if (strcmp(argv[index], "-jit") == 0 || strcmp(argv[index], "-jitfma") == 0) // before -j.
+        {
+            context.jit = true;
+            context.fusedMultiplyAdd = (argLen == 7);
+        }
+        else if (argv[index][1] == 'j' && (argLen == 2 || isDigits(argv[index] + 2)))
         {
-            if (arg1Len > 2)
+            const char* pcCount = argv[index] + 2; // either -jN, -j N or just -j (all the cores).
+            if (*pcCount == '\0' && index + 1 < argc && isDigits(argv[index + 1]))
+                pcCount = argv[++index];
+
+            int n = atoi(pcCount);
+            workers = (n > 0 ? n : WorkStealingPool::defaultWorkerCount());
+        }
+        else if (argv[index][1] == 'j') // no function starts with j, so it can only be a wrong thread count.
+        {
+            std::cout << "\nERROR in the thread count (-j <threads>): " << argv[index] << '\n';
+            return EXIT_FAILURE;
+        }
+        else if (strcmp(argv[index], "-i") == 0)
+        {
+            context.interactive = true;
+        }
+        else if (strcmp(argv[index], "-stats") == 0)
+        {
+            context.statistics.emplace_back(new PhaseStatistics);
+        }
+        else if (strcmp(argv[index], "-stack") == 0)
+        {
+            context.engine = ExpressionParser::Engine::operatorStack;
+        }
+        else if (strcmp(argv[index], "-simd") == 0)
+        {
+            context.vectorMath = true;
+        }
+        else if (strcmp(argv[index], "-precision") == 0 && index + 1 < argc)
+        {
+            char* pcNext = nullptr;
+            const char* pcError = argv[++index];
+            maxError = strtod(pcError, &pcNext);
+            if (pcNext == pcError || *pcNext != '\0' || !std::isfinite(maxError) || maxError <= 0)
+            {
+                std::cout << "\nERROR in the relative error (-precision <error>, finite and over 0): "
+                          << pcError << '\n';
+                return EXIT_FAILURE;
+            }
+
+            context.vectorMath = true;
+            context.precision = VectorMath::choosePrecision(maxError);
+        }
+        else if (argv[index][1] == 'c' && (argLen == 2 || isDigits(argv[index] + 2)))
+        {
+            const char* pcEntries = argv[index] + 2; // either -cN, -c N or just -c.
+            if (*pcEntries == '\0' && index + 1 < argc && isDigits(argv[index + 1]))
+                pcEntries = argv[++index];
+
+            int n = atoi(pcEntries);
+            context.pCache.reset(new ExpressionCache(n > 0 ? n : defaultCacheEntries));
+        }
+        else if (argLen == 2 && argv[index][1] == 'f' && index + 1 < argc)
+        {
+            inputFiles.push_back(argv[++index]);
+        }
+        else if (argLen > 1 && argv[index][1] == 'v')
+        {
+            if (argLen > 2)
             {
-                char c = argv[1][2];
+                char c = argv[index][2];
                 if ('3' <= c && c <= '9')
-                    verbosity = ExpressionParser::Verbosity::extra;
+                    context.verbosity = ExpressionParser::Verbosity::extra;
                 else if (c == '2')
-                    verbosity = ExpressionParser::Verbosity::full;
+                    context.verbosity = ExpressionParser::Verbosity::full;
                 else if (c == '1')
-                    verbosity = ExpressionParser::Verbosity::partial;
+                    context.verbosity = ExpressionParser::Verbosity::partial;
                 else
-                    verbosity = ExpressionParser::Verbosity::none;
+                    context.verbosity = ExpressionParser::Verbosity::none;
             }
-            else // argv[1] == "-v"
+            else // argv[index] == "-v"
             {
-                verbosity = ExpressionParser::Verbosity::partial;
+                context.verbosity = ExpressionParser::Verbosity::partial;
             }
         }
-        index++;
+        else
+            break; // not an option, but the first expression (like -2+3), or "-" for stdin.
     }
 
-    bool success = true;
-    int base = (index - 1);
-    NodeFactory<OperationItem>::getOrCreateInstance();
-
-    for(; index < argc; index++)
+    if (index >= argc && inputFiles.empty() && !context.interactive)
     {
-        if (verbosity == ExpressionParser::Verbosity::none)
-            std::cout << "\nExpression #" << (index - base) <<  " : ";
-        else
-            std::cout << '\n' << szTitle1 << szTitle2 << (index - base) << ' ' << szTitle1 << '\n';
+        std::cout << "Usage: calc [-j <threads>] [-c <entries>] [-stats] [-stack] [-jit[fma]] [-simd] [-v[0-3]]\n"
+        << "            [-precision <error>] [-i] [-f <file>] [<name>=<start>:<end>:<step> ...]"
+        << " [<expression 1> ... <expression n>] [-]\n"
+        << "Example: calc -v1 1+1 5-6/2+3*4 '3+4*(2+1*1*(4-(1+1)))-16' 1*2*3*(2-1/3) '(4 + 5 * (7 - 3)) - 2'\n"
+        << "         -j 0 evaluates in parallel using all the cores (-j N using N threads).\n"
+        << "         -f <file> evaluates every line of the file, and - every line of the standard input.\n"
+        << "         -c 1000 caches 1000 entries (-c 0, the default size), an expression under its text and\n"
+        << "            its canonical form, so about the last 500 distinct expressions.\n"
+        << "         -stats prints the time spent in every phase, and its latency percentiles.\n"
+        << "         -stack builds the trees with an explicit operator stack, instead of climbing them.\n"
+        << "         x=0:1:0.25 'x^2' tabulates the expressions over the grid of the variables.\n"
+        << "         -jit tabulates them with x86-64 machine code (-jitfma fusing a*b+c, rounded once).\n"
+        << "         -simd tabulates their functions by vectorized kernels, within a few ULP of libm.\n"
+        << "         -precision 1e-6 does it with faster polynomials, within that relative error.\n"
+        << "         -i answers every line of the standard input at once, on a line of its own.\n"
+        << std::endl;
+       return EXIT_FAILURE;
+    }
 
-        ExpressionParser parser(argv[index], verbosity);
-        if (!parser.finishedOK())
+    for (int i = index; i < argc; i++)
+        if (strchr(argv[i], '=') != nullptr) // a grid variable, no expression contains '='.
         {
-            char cBad = parser.getFaultyChar();
-            int  pos = parser.getExpressionIndex();
-            int errorCode = parser.getIntError();
-            std::cout << "ERROR " << errorCode << " parsing the expresion:\n"
-                      << argv[index] << '\n';
-
-            if (cBad != '\0')
+            std::string name;
+            GridVariable variable;
+            if (!parseGridVariable(argv[i], name, variable))
             {
-                std::cout << (pos >= 2 ? std::string(pos, ' ') : "") << "^-----\n"
-                        << "At position " << pos << " got character \""
-                        << cBad << "\" .\n";
+                std::cout << "\nERROR in the grid variable (name=start:end:step): " << argv[i] << '\n';
+                return EXIT_FAILURE;
             }
 
-            std::cout << parser.getLastErrorMessage()
-                      << " Ignoring it!\n";
-            success = false;
-            continue;
+            context.variableNames.push_back(name);
+            context.grid.push_back(variable);
         }
-        else if (verbosity != ExpressionParser::Verbosity::none)
-            parser << std::cout << std::endl;
 
-        ArithmeticEvaluator evaluator(parser.getTree());
-        if (!evaluator)
-        {
-            std::cout << "ERROR " << evaluator.getError() << " parsing the expresion: " << argv[index] << " . Ignoring it!\n";
+    if (maxError > 0 && context.grid.empty()) // the kernels only run over the batches of the tabulations.
+    {
+        std::cout << "\nERROR -precision applies to tabulations, give the grid variables (name=start:end:step).\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout.precision(15);
+    if (maxError > 0)
+        std::cout << "Tabulated functions within a relative error of " << VectorMath::getMaxError(context.precision)
+                  << " (" << maxError << " asked), by the " << VectorMath::getInstructionSet() << " kernels.\n";
+
+    if (workers > 1 && context.verbosity < ExpressionParser::Verbosity::full // full debug traces go straight to cout.
+        && context.grid.empty() // a tabulation is streamed as it is evaluated.
+        && !context.interactive) // and the answers are given one by one.
+        context.pPool.reset(new WorkStealingPool(workers));
+
+    unsigned factoryCount = (context.pPool ? context.pPool->getWorkerCount() : 1);
+    for (unsigned w = 0; w < factoryCount; w++)
+        context.factories.emplace_back(new Factory(Factory::Allocation::arena)); // one tree alive at a time.
+
+    if (!context.statistics.empty())
+    {
+        context.statistics.resize(1);
+        for (unsigned w = 1; w < factoryCount; w++)
+            context.statistics.emplace_back(new PhaseStatistics);
+
+        PhaseStatistics::current() = context.statistics[0].get(); // the sequential evaluation, in this thread.
+    }
+
+    bool success = true;
+    int number = 1;
+    for (const char* path : inputFiles)
+        if (! evaluateInput(path, number, context))
             success = false;
-            continue;
+
+    std::vector<Line> expressions;
+    bool inputAnswered = false; // with -i, the standard input is read at the end if no "-" came before.
+    for(; index < argc; index++)
+    {
+        if (strcmp(argv[index], "-") == 0) // standard input, in its argument order.
+        {
+            if (! evaluateLines(expressions, number, context))
+                success = false;
+
+            number += int(expressions.size());
+            expressions.clear();
+            if (! (context.interactive ? evaluateInteractively(number, context)
+                                       : evaluateInput(argv[index], number, context)))
+                success = false;
+            inputAnswered = true;
         }
+        else if (strchr(argv[index], '=') == nullptr)
+            expressions.push_back({argv[index], strlen(argv[index])});
+    }
 
-        std::cout.precision(15);
-        std::cout << "Result = " << evaluator.getResult();
-        if (verbosity == ExpressionParser::Verbosity::none)
-            std::cout << '\n';
-        else
-        std::cout << '\n' << szTitle1 << szTitle3 << szTitle1 << '\n';
+    if (! evaluateLines(expressions, number, context))
+        success = false;
+
+    number += int(expressions.size());
+    if (context.interactive && !inputAnswered && ! evaluateInteractively(number, context)) // after the rest.
+        success = false;
+
+    if (!context.statistics.empty())
+    {
+        for (size_t w = 1; w < context.statistics.size(); w++)
+            context.statistics[0]->merge(*context.statistics[w]);
+        context.statistics[0]->print(std::cerr);
+    }
+
+    if (context.pCache)
+    {
+        ExpressionCache::Statistics stats = context.pCache->getStatistics();
+        std::cerr << "\nCache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.evictions << " evictions, " << stats.entries << " of "
+                  << context.pCache->getCapacity() << " entries used.\n";
     }
 
-    NodeFactory<OperationItem>::destroyInstance();
     return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -5,18 +5,45 @@
  * @date 2019-10-27
  */
 
+#include <algorithm>
+#include <cmath>
+#include <atomic>
 #include <cassert>
+#include <cfloat>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "test-macros.h"
 #include "NodeFactory.h"
 #include "ExpressionParser.h"
+#include "LineReader.h"
 #include "ArithmeticEvaluator.h"
+#include "CompactTree.h"
+#include "CompiledExpression.h"
+#include "ConstexprExpression.h"
+#include "DecimalConverter.h"
+#include "ExpressionCache.h"
+#include "GammaFunction.h"
+#include "JitExpression.h"
 #include "OperationItem.h"
+#include "PhaseStatistics.h"
+#include "TreeOptimizer.h"
+#include "VectorMath.h"
+#include "WorkStealingPool.h"
 
 void nodeTests(TEST_REF)
 {
-    NodeFactory<OperationItem>* factory = NodeFactory<OperationItem>::getOrCreateInstance();
+    NodeFactory<OperationItem> nodeFactory;
+    NodeFactory<OperationItem>* factory = &nodeFactory;
     Node<OperationItem>* pA = factory->createNode(OperationItem(OperationId::openParenthesis));
     Node<OperationItem>* pB = factory->createNode(OperationItem(OperationId::number, 255));
     pB->setParent(nullptr); // B will be the root node
@@ -38,6 +65,86 @@ void nodeTests(TEST_REF)
     factory->destroyNode(pC);
 }
 
+void slotRecyclingTests(TEST_REF)
+{
+    NodeFactory<OperationItem> nodeFactory;
+    NodeFactory<OperationItem>* factory = &nodeFactory;
+    Node<OperationItem>* pKeep = factory->createNode(OperationItem(OperationId::number, 0));
+    bool allOK = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        ExpressionParser parser("(1 + 2) * 3 - 4 / 5", ExpressionParser::Verbosity::none, nodeFactory);
+        allOK = allOK && parser.finishedOK();
+    }
+
+    EXPECT_TRUE(allOK);
+
+    EXPECT_EQ(factory->getLiveNodes(), 1u);
+    EXPECT_LE(factory->getSlotCount(), 16u); // bounded by the peak of live nodes, not the created ones.
+    factory->destroyNode(pKeep);
+    EXPECT_EQ(factory->getLiveNodes(), 0u);
+    EXPECT_EQ(factory->getSlotCount(), 0u);
+}
+
+void arenaTests(TEST_REF)
+{
+    using Allocation = NodeFactory<OperationItem>::Allocation;
+    NodeFactory<OperationItem> nodeFactory;
+    NodeFactory<OperationItem>* factory = &nodeFactory;
+    EXPECT_TRUE(factory->setAllocation(Allocation::arena));
+    EXPECT_TRUE(factory->getAllocation() == Allocation::arena);
+
+    Node<OperationItem>* pFirst = factory->createNode(OperationItem(OperationId::number, 1));
+    Node<OperationItem>* pSecond = factory->createNode(OperationItem(OperationId::number, 2));
+    EXPECT_EQ(pFirst + 1, pSecond); // bumped contiguously from the same chunk.
+    EXPECT_EQ(pSecond->getSequenceNo(), 1);
+
+    factory->reset(); // all the nodes are released at once, storage is bumped again from the start.
+    Node<OperationItem>* pAgain = factory->createNode(OperationItem(OperationId::number, 3));
+    EXPECT_EQ(pAgain, pFirst);
+    EXPECT_EQ(pAgain->getSequenceNo(), 0);
+    EXPECT_EQ(pAgain->getData().value, 3);
+
+    for (int i = 0; i < 100000; i++) // spans several chunks.
+        factory->createNode(OperationItem(OperationId::number, i));
+    factory->reset();
+
+    for (int i = 0; i < 2; i++)
+    {
+        ExpressionParser parser("1 + 2 * (3 - 4)", ExpressionParser::Verbosity::none, nodeFactory);
+        EXPECT_TRUE(parser.finishedOK());
+        EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), -1);
+    }
+
+    EXPECT_Z(factory->getLiveTrees());
+    {
+        auto pFirstParser = std::make_unique<ExpressionParser>("1 + 2 * 3", ExpressionParser::Verbosity::none,
+                                                               nodeFactory);
+        {
+            ExpressionParser second("(4 - 5) * 6", ExpressionParser::Verbosity::none, nodeFactory);
+            EXPECT_EQ(factory->getLiveTrees(), 2u);
+            EXPECT_EQ(ArithmeticEvaluator(second.getTree()).getResult(), -6);
+        } // the arena is not reset under the first tree.
+
+        EXPECT_EQ(factory->getLiveTrees(), 1u);
+        ExpressionParser third("8 / 4", ExpressionParser::Verbosity::none, nodeFactory);
+        EXPECT_EQ(ArithmeticEvaluator(pFirstParser->getTree()).getResult(), 7);
+        EXPECT_EQ(ArithmeticEvaluator(third.getTree()).getResult(), 2);
+
+        Node<OperationItem>* pFirstRoot = pFirstParser->getTree()->getRoot();
+        pFirstParser.reset(); // the first parser goes before the third one: no reset yet either.
+        EXPECT_EQ(factory->getLiveTrees(), 1u);
+        Node<OperationItem>* pBumped = factory->createNode(OperationItem(OperationId::number, 9));
+        EXPECT_NEQ(pBumped, pFirstRoot);
+        EXPECT_EQ(ArithmeticEvaluator(third.getTree()).getResult(), 2);
+    }
+
+    EXPECT_Z(factory->getLiveTrees()); // the last tree gone, the arena was reset.
+    EXPECT_EQ(factory->createNode(OperationItem(OperationId::number, 10)), pFirst);
+
+    EXPECT_TRUE(factory->setAllocation(Allocation::heap));
+}
+
 void badParsingTests(TEST_REF)
 {
     ExpressionParser::Error error0 =  ExpressionParser::Error::success;
@@ -88,6 +195,228 @@ void badParsingTests(TEST_REF)
     }
 }
 
+void functionNameTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    int unresolved = 0;
+    unsigned first = static_cast<unsigned>(OperationId::firstFunction);
+    unsigned last = static_cast<unsigned>(OperationId::lastFunction);
+    for (unsigned u = first; u <= last; u++) // every name in the table must reach its own operation.
+    {
+        std::string expression(OperationItem::operandTable[u].symbol);
+        expression += "(1)";
+        ExpressionParser parser(expression.c_str(), ExpressionParser::Verbosity::none, factory);
+        if (!parser.finishedOK() || parser.getTree()->getRoot()->getData().id != OperationItem::operandTable[u].id)
+            unresolved++;
+    }
+
+    EXPECT_Z(unresolved);
+
+    static const char* unknown[4] = {"foo(1)", "sinx(1)", "co(1)", "sqr(1)"};
+    for (const char* expression : unknown)
+    {
+        ExpressionParser parser(expression, ExpressionParser::Verbosity::none, factory);
+        EXPECT_EQ(int(parser.getError()), int(ExpressionParser::Error::unknownFunction));
+    }
+}
+
+void tokenizerTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    std::string sum("1");
+    for (int i = 0; i < 99; i++) // 199 tokens, several blocks.
+        sum += (i % 2 ? " + (1)" : "+1");
+
+    ExpressionParser parser(sum.c_str(), ExpressionParser::Verbosity::none, factory);
+    EXPECT_TRUE(parser.finishedOK());
+    EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), 100.0);
+
+    std::string late = sum + " * $";
+    ExpressionParser lateError(late.c_str(), ExpressionParser::Verbosity::none, factory);
+    EXPECT_EQ(int(lateError.getError()), int(ExpressionParser::Error::unknownChar));
+    EXPECT_EQ(lateError.getExpressionIndex(), int(late.length() - 1));
+
+    static const char* wrong[5] = {"2 $ (3", "  (1 + 2", ")(1", "(2))+(1", " \t "};
+    static const int indexes[5] = {6, 8, 0, 3, 3}; // unbalanced at the end, before a wrong item, if they count.
+    static const ExpressionParser::Error errors[5] =
+    {
+        ExpressionParser::Error::noMatchingParenthesis, ExpressionParser::Error::noMatchingParenthesis,
+        ExpressionParser::Error::noMatchingParenthesis, ExpressionParser::Error::noMatchingParenthesis,
+        ExpressionParser::Error::voidExpression
+    };
+
+    for (int i = 0; i < 5; i++)
+    {
+        ExpressionParser parser(wrong[i], ExpressionParser::Verbosity::none, factory);
+        EXPECT_EQ(int(parser.getError()), int(errors[i]));
+        EXPECT_EQ(parser.getExpressionIndex(), indexes[i]);
+    }
+}
+
+void parserEngineTests(TEST_REF)
+{
+    static const char* expressions[12] =
+    {
+        "1 + ", "2^3^2", "-2^2 + +3! * 4", "sin(pi/2) - cos(0) * exp(1)", "((1 + 2) * (3 - (4 / 5)))",
+        "5 - 3 - 1 % 2 / 4", "2 * -(3 + 4)!", "gama(5) ^ 0.5 ^ 2", "1 + (2 * 3", "3 sin 4", "2 ** 3", ")(1"
+    };
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    NodeFactory<OperationItem> stackFactory(NodeFactory<OperationItem>::Allocation::arena);
+    int differences = 0;
+    for (const char* expression : expressions) // the same errors, or the very same tree.
+    {
+        ExpressionParser climbing(expression, ExpressionParser::Verbosity::none, factory);
+        ExpressionParser stack(expression, ExpressionParser::Verbosity::none, stackFactory, nullptr,
+                               ExpressionParser::Engine::operatorStack);
+        if (climbing.getError() != stack.getError() || climbing.getExpressionIndex() != stack.getExpressionIndex())
+            differences++;
+        else if (climbing.finishedOK())
+        {
+            std::ostringstream osClimbing, osStack;
+            climbing.printTree(osClimbing);
+            stack.printTree(osStack);
+            if (osClimbing.str() != osStack.str())
+                differences++;
+        }
+    }
+
+    EXPECT_Z(differences);
+
+    std::string chain("2");
+    for (int i = 0; i < 1000; i++)
+        chain += "^1";
+
+    ExpressionParser stack(chain.c_str(), ExpressionParser::Verbosity::none, stackFactory, nullptr,
+                           ExpressionParser::Engine::operatorStack);
+    EXPECT_EQ(ArithmeticEvaluator(stack.getTree()).getResult(), 2.0);
+}
+
+void deepTreeTests(TEST_REF)
+{
+    NodeFactory<OperationItem> heap; // destroyed node by node, by the parser.
+    std::string negations(1000000, '-'); // a million levels deep, far beyond the machine stack of a recursion.
+    negations += "2";
+    {
+        ExpressionParser parser(negations.c_str(), ExpressionParser::Verbosity::none, heap);
+        EXPECT_TRUE(parser.finishedOK());
+        EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), 2.0);
+    }
+    EXPECT_Z(heap.getLiveNodes());
+
+    ExpressionParser::VariableNames names = {"a", "b"};
+    std::string deepShared(100, '-'); // the shared subtrees are below the levels evaluated by recursion.
+    deepShared += "(sin(a*b) + cos(a*b) * (a*b))";
+    {
+        ExpressionParser parser(deepShared.c_str(), ExpressionParser::Verbosity::none, heap, &names);
+        double values[2] = {0.75, -1.25};
+        double expected = ArithmeticEvaluator(parser.getTree(), values).getResult();
+        TreeOptimizer optimizer(parser.getTree(), heap);
+        EXPECT_EQ(optimizer.shareSubexpressions(), size_t(6));
+        EXPECT_EQ(ArithmeticEvaluator(parser.getTree(), values).getResult(), expected);
+    }
+    EXPECT_Z(heap.getLiveNodes()); // a DAG destroyed along the owning edges.
+
+    std::string nested;
+    for (int i = 0; i < 100; i++)
+        nested += "-(1+";
+    nested += "1" + std::string(100, ')');
+
+    ExpressionParser parser(nested.c_str(), ExpressionParser::Verbosity::none, heap);
+    std::ostringstream os;
+    parser.printTree(os);
+    std::string printed = os.str();
+    EXPECT_EQ(std::count(printed.begin(), printed.end(), '\n'), 301); // every node, in a line of its own.
+}
+
+void treeVisitorTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser parser("1 - 2 * 3", ExpressionParser::Verbosity::none, factory); // (- 1 (* 2 3))
+    Node<OperationItem>* pRoot = parser.getTree()->getRoot();
+    auto symbols = [] (std::string& s) {
+        return [&s] (const Node<OperationItem>* pNode, size_t) {
+            if (pNode->getData().id == OperationId::number)
+                s += static_cast<char>('0' + pNode->getData().value);
+            else
+                s += pNode->getData().symbol;
+        };
+    };
+
+    std::string pre, in, post, reversed;
+    Tree<OperationItem>::visitPreOrder(pRoot, [visit = symbols(pre)] (Node<OperationItem>* pNode, size_t depth) {
+        visit(pNode, depth);
+        return true;
+    });
+    Tree<OperationItem>::visitInOrder(pRoot, symbols(in));
+    Tree<OperationItem>::visitPostOrder(pRoot, symbols(post));
+    Tree<OperationItem>::visitInOrder(pRoot, symbols(reversed), true);
+    size_t visited = 0, maxDepth = 0;
+    Tree<OperationItem>::visitPreOrder(pRoot, [&visited, &maxDepth] (Node<OperationItem>* pNode, size_t depth) {
+        visited++;
+        maxDepth = std::max(maxDepth, depth);
+        return pNode->getData().id != OperationId::multiply; // not under the '*'.
+    });
+
+    EXPECT_EQ(pre, "-1*23");
+    EXPECT_EQ(in, "1-2*3");
+    EXPECT_EQ(post, "123*-");
+    EXPECT_EQ(reversed, "3*2-1");
+    EXPECT_EQ(visited, size_t(3));
+    EXPECT_EQ(maxDepth, size_t(1));
+
+    Tree<OperationItem>* pTree = parser.getTree();
+    pTree->goDownRightMost(); // on the 3, then up while binding tighter (a lower priority) than the '-'.
+    char priority = pRoot->getData().priority;
+    Node<OperationItem>* pFound = pTree->searchUp([priority] (const Node<OperationItem>* pNode) {
+        return pNode->getData().priority < priority;
+    });
+    EXPECT_TRUE(pFound == pRoot);
+    EXPECT_TRUE(pTree->getCurrent() == pRoot);
+}
+
+void numberParsingTests(TEST_REF)
+{
+    static const char* literals[] =
+    {
+        "0", "7", "3.", ".5", "0.1", "0.30000000000000004", "2e3", "1.5e-3", "2E+2", "123456.789e-3",
+        "9007199254740993", "9007199254740995", "1234567890123456789", "2.225073858507e-308",
+        "4.9406564584e-324", "1.797693134862e308", "1.8e308", "1e-400", "1e400"
+    };
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    int mismatches = 0;
+    for (const char* literal : literals)
+    {
+        ExpressionParser parser(literal, ExpressionParser::Verbosity::none, factory);
+        double expected = strtod(literal, nullptr);
+        double parsed = (parser.finishedOK() ? ArithmeticEvaluator(parser.getTree()).getResult() : -1);
+        if (memcmp(&parsed, &expected, sizeof(double)) != 0) // bit for bit.
+            mismatches++;
+    }
+
+    EXPECT_Z(mismatches);
+    EXPECT_EQ(DecimalConverter::toDouble(0, 500), 0.0);
+    EXPECT_EQ(DecimalConverter::toDouble(45035996273704985ULL, -1), 4503599627370498.0); // a tie, to even.
+    EXPECT_EQ(DecimalConverter::toDouble(1, -1), 0.1);
+
+    ExpressionParser exponentOnly("1e+", ExpressionParser::Verbosity::none, factory);
+    EXPECT_EQ(ArithmeticEvaluator(exponentOnly.getTree()).getResult(), 1.0); // an exponent without digits is 0.
+
+    static const char* wrong[4] = {"2e", "2e3e", "1e5.5", "1.2.3"};
+    static const ExpressionParser::Error errors[4] =
+    {
+        ExpressionParser::Error::missingOp, ExpressionParser::Error::missingOp, // not an exponent, but e.
+        ExpressionParser::Error::incorrectDecimalPoint, ExpressionParser::Error::incorrectDecimalPoint
+    };
+
+    for (int i = 0; i < 4; i++)
+    {
+        ExpressionParser parser(wrong[i], ExpressionParser::Verbosity::none, factory);
+        EXPECT_EQ(int(parser.getError()), int(errors[i]));
+    }
+}
+
 void parseAndEvaluatorTests(TEST_REF)
 {
     const int result0 =  2;
@@ -142,18 +471,910 @@ void parseAndEvaluatorTests(TEST_REF)
     EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), 12.5);
 }
 
-template <>
-NodeFactory<OperationItem>* NodeFactory<OperationItem>::pInstance(nullptr);
+void compiledExpressionTests(TEST_REF)
+{
+    static const char* expressions[8] =
+    {
+        "3+4*(2+1*1*(4-(1+1)))-(9 + 7)", "1 + ", "-2^2 + (5!) / 3 % 7", "+(1 - 8) * sin(pi/3) - cos(e)",
+        "sqrt(2) * curt(-27) + ln(10) - log(1000) + ltwo(8)", "gama(4.5) - tanh(0.5) + exp(1.5)",
+        "asin(0.5) + acos(0.5) + atan(1) + asih(1) + acoh(2) + atah(0.5)", "2^3^2 - sinh(1) * cosh(1) / tan(1)"
+    };
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    for (const char* expression : expressions)
+    {
+        ExpressionParser parser(expression, ExpressionParser::Verbosity::none, factory);
+        EXPECT_TRUE(parser.finishedOK());
+
+        CompiledExpression program(parser.getTree());
+        EXPECT_FALSE(program.isEmpty());
+        double compiled = program.evaluate();
+        EXPECT_EQ(compiled, ArithmeticEvaluator(parser.getTree()).getResult()); // bit for bit.
+        EXPECT_EQ(program.evaluate(), compiled); // it can be evaluated again and again.
+    }
+
+    std::string deep(1000, '(');
+    deep += "1" + std::string(1000, ')');
+    for (int i = 0; i < 200; i++)
+        deep = "2*" + deep + "-1";
+
+    ExpressionParser parser(deep.c_str(), ExpressionParser::Verbosity::none, factory);
+    CompiledExpression program(parser.getTree());
+    EXPECT_EQ(program.evaluate(), ArithmeticEvaluator(parser.getTree()).getResult());
+
+    std::string nested; // compiled without recursion, whatever the depth.
+    for (int i = 0; i < 100000; i++)
+        nested += "sin(";
+
+    ExpressionParser nestedParser((nested + "1" + std::string(100000, ')')).c_str(), ExpressionParser::Verbosity::none,
+                                  factory);
+    CompiledExpression nestedProgram(nestedParser.getTree());
+    EXPECT_EQ(nestedProgram.getSize(), size_t(100001));
+    EXPECT_EQ(nestedProgram.evaluate(), ArithmeticEvaluator(nestedParser.getTree()).getResult());
+}
+
+// Parsed by the compiler: a constant expression folds into a literal, a parse error is a compile error.
+static constexpr ConstexprExpression constantExpression("-2^2 + (5!) / 3 % 7 - +(1.5e3 * .25 - 4^(1+2))");
+static constexpr ConstexprExpression polynomialExpression("x^3 - 3*x*y + 2*(y - 1)/(x + 2) - -x", {"x", "y"});
+static constexpr ConstexprExpression functionExpression("sin(x/2) - cos(y) * e / gama(4.5) + sqrt(pi*x)", {"x", "y"});
+static_assert(constantExpression.evaluate() == -4 + 40 % 7 - 311, "folded into a literal");
+static_assert(ConstexprExpression("(170!) / gama(171)").evaluate() == 1 && ConstexprExpression("171!").evaluate() > DBL_MAX,
+              "factorials looked up");
+static_assert(ConstexprExpression("2 ** 3").getError() == ExpressionParser::Error::contiguousOp
+              && ConstexprExpression("2 ** 3").getExpressionIndex() == 3, "the error of ExpressionParser");
+
+void constexprExpressionTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser::VariableNames names = {"x", "y"};
+    double values[2] = {0.75, -1.25};
+    static const char* expressions[4] = {"1 + ", "pi - e * phi", "3 % sen1 + 2", "(1 + (4 * 2) ! 3"};
+    for (const char* expression : expressions) // parsed at run time too, the same way.
+    {
+        ExpressionParser parser(expression, ExpressionParser::Verbosity::none, factory);
+        ConstexprExpression<64> constexprExpression(expression);
+        EXPECT_TRUE(constexprExpression.getError() == parser.getError());
+        EXPECT_EQ(constexprExpression.getExpressionIndex(), parser.getExpressionIndex());
+        EXPECT_EQ(constexprExpression.getFaultyChar(), parser.getFaultyChar());
+        if (parser.finishedOK())
+            EXPECT_EQ(constexprExpression.evaluate(), ArithmeticEvaluator(parser.getTree()).getResult());
+    }
+
+    ExpressionParser constantParser("-2^2 + (5!) / 3 % 7 - +(1.5e3 * .25 - 4^(1+2))", ExpressionParser::Verbosity::none);
+    EXPECT_EQ(constantExpression.evaluate(), ArithmeticEvaluator(constantParser.getTree()).getResult());
+
+    ExpressionParser polynomialParser("x^3 - 3*x*y + 2*(y - 1)/(x + 2) - -x", ExpressionParser::Verbosity::none,
+                                      factory, &names);
+    double expected = ArithmeticEvaluator(polynomialParser.getTree(), values).getResult();
+    EXPECT_EQ(polynomialExpression.evaluate(values), expected);
+    EXPECT_EQ(evaluateUnrolled<polynomialExpression>(values), expected); // bit for bit.
+    EXPECT_EQ(evaluateUnrolled<polynomialExpression>(), ArithmeticEvaluator(polynomialParser.getTree()).getResult());
+
+    ExpressionParser functionParser("sin(x/2) - cos(y) * e / gama(4.5) + sqrt(pi*x)", ExpressionParser::Verbosity::none,
+                                    factory, &names);
+    double (*function)(const double*) = &evaluateUnrolled<functionExpression>;
+    EXPECT_EQ(function(values), ArithmeticEvaluator(functionParser.getTree(), values).getResult());
+    EXPECT_EQ(functionExpression.getVariableCount(), 2u);
+}
+
+void compactTreeTests(TEST_REF)
+{
+    static const char* expressions[6] =
+    {
+        "1 + ", "2^3^2 - 4!", "-2^2 + +3 * 4 % 5", "sin(pi/2) - cos(0) * exp(1) / gama(4.5)",
+        "((1 + 2) * (3 - (4 / 5)))", "sqrt(2) * ln(10) - atan(1) * 4"
+    };
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    int mismatches = 0;
+    for (const char* expression : expressions)
+    {
+        ExpressionParser parser(expression, ExpressionParser::Verbosity::none, factory);
+        CompactTree compact(parser.getTree());
+        if (compact.evaluate() != ArithmeticEvaluator(parser.getTree()).getResult()) // bit for bit.
+            mismatches++;
+    }
+
+    EXPECT_Z(mismatches);
+
+    ExpressionParser::VariableNames names = {"a", "b"};
+    ExpressionParser parser("sin(a*b) + cos(a*b) * (a*b) - 8 / b", ExpressionParser::Verbosity::none, factory, &names);
+    CompactTree compact(parser.getTree());
+    EXPECT_EQ(compact.getSize(), size_t(17));
+    EXPECT_TRUE(compact.getId(compact.getRoot()) == OperationId::minus);
+    EXPECT_EQ(int(compact.getPriority(compact.getRoot())), 6);
+    EXPECT_EQ(compact.getSymbol(compact.getRoot())[0], '-');
+
+    bool postOrder = true; // the children, before their parent.
+    for (uint32_t i = 0; i < compact.getSize(); i++)
+        if ((compact.getLeft(i) != CompactTree::noChild && compact.getLeft(i) >= i)
+            || (compact.getRight(i) != CompactTree::noChild && compact.getRight(i) >= i))
+            postOrder = false;
+
+    EXPECT_TRUE(postOrder);
+
+    double values[2] = {0.75, -1.25};
+    double expected = ArithmeticEvaluator(parser.getTree(), values).getResult();
+    TreeOptimizer optimizer(parser.getTree(), factory);
+    EXPECT_EQ(optimizer.shareSubexpressions(), size_t(7)); // the second and third a*b, and the last b.
+    compact.build(parser.getTree());
+    EXPECT_EQ(compact.getSize(), size_t(10)); // every shared node stored once.
+    EXPECT_EQ(compact.evaluate(values), expected);
+}
+
+void jitExpressionTests(TEST_REF)
+{
+    if (!JitExpression::isSupported())
+        return;
+
+    static const char* expressions[8] =
+    {
+        "1 + ", "2^3^2 - 4! + 7 % 5", "-2^2 + +3 * 4 % 5 - +(-0)", "sin(x/2) - cos(y) * exp(1) / gama(4.5)",
+        "((x + 2) * (3 - (y / 5)))", "sqrt(2) * ln(x) - atan(y) * 4 + curt(-27)",
+        "asin(0.5) + acos(0.5) + asih(x) + acoh(2) + atah(0.5) - tanh(y) + log(x) * ltwo(x)",
+        "sinh(x) * cosh(y) / tan(x) - x*y + -(x*y - y*x)"
+    };
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser::VariableNames names = {"x", "y", "z"};
+    double values[3] = {0.75, -1.25, 3.0};
+    int mismatches = 0;
+    for (const char* expression : expressions)
+    {
+        ExpressionParser parser(expression, ExpressionParser::Verbosity::none, factory, &names);
+        JitExpression jit(parser.getTree());
+        EXPECT_FALSE(jit.isEmpty());
+        double expected = ArithmeticEvaluator(parser.getTree(), values).getResult();
+        double compiled = jit.getFunction()(values);
+        double unset = ArithmeticEvaluator(parser.getTree()).getResult(); // the variables are 0.
+        double compiledUnset = jit.evaluate();
+        if (memcmp(&compiled, &expected, sizeof(double)) != 0 || memcmp(&compiledUnset, &unset, sizeof(double)) != 0)
+            mismatches++;
+
+        TreeOptimizer optimizer(parser.getTree(), factory); // the shared results, kept in the stack frame.
+        optimizer.shareSubexpressions();
+        jit.compile(parser.getTree());
+        compiled = jit.evaluate(values);
+        if (memcmp(&compiled, &expected, sizeof(double)) != 0)
+            mismatches++;
+    }
+
+    EXPECT_Z(mismatches);
+
+    std::string deep = "y", deepFused = "y"; // the deeper stack positions are not registers, but frame slots.
+    for (int i = 0; i < 24; i++)
+    {
+        deep = "sin(x) - y*(-(" + deep + ") % 3 + x^2)";
+        deepFused = "x - y*(" + deepFused + ")";
+    }
+
+    ExpressionParser deepParser(deep.c_str(), ExpressionParser::Verbosity::none, factory, &names);
+    JitExpression deepJit(deepParser.getTree());
+    EXPECT_EQ(deepJit.evaluate(values), ArithmeticEvaluator(deepParser.getTree(), values).getResult());
+
+    ExpressionParser fusedParser(deepFused.c_str(), ExpressionParser::Verbosity::none, factory, &names);
+    JitExpression deepFusedJit(fusedParser.getTree(), true);
+    double fusedResult = values[1];
+    for (int i = 0; i < 24; i++)
+        fusedResult = (deepFusedJit.isFused() ? fma(-values[1], fusedResult, values[0])
+                                              : values[0] - values[1] * fusedResult);
+    EXPECT_EQ(deepFusedJit.evaluate(values), fusedResult);
+
+    double a = 1 + ldexp(1, -30), b = 1 - ldexp(1, -30); // a*b is 1 - 2^-60, rounded to 1 unless fused.
+    static const char* multiplyAdds[4] = {"z + x*y", "x*y + z", "x*y - z", "z - x*y"};
+    double operands[4][3] = {{a, b, -1}, {a, b, -1}, {a, b, 1}, {a, b, 1}};
+    double fusedResults[4] = {fma(a, b, -1), fma(a, b, -1), fma(a, b, -1), fma(-a, b, 1)}; // rounded once.
+    for (int i = 0; i < 4; i++)
+    {
+        ExpressionParser parser(multiplyAdds[i], ExpressionParser::Verbosity::none, factory, &names);
+        JitExpression exact(parser.getTree());
+        EXPECT_FALSE(exact.isFused());
+        EXPECT_EQ(exact.evaluate(operands[i]), 0.0);
+
+        JitExpression fused(parser.getTree(), true);
+        EXPECT_EQ(fused.isFused(), JitExpression::hasFusedMultiplyAdd());
+        EXPECT_EQ(fused.evaluate(operands[i]), fused.isFused() ? fusedResults[i] : 0.0);
+    }
+}
+
+void variableTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser::VariableNames names = {"x", "y2", "rate"};
+
+    ExpressionParser undeclared("2 * x", ExpressionParser::Verbosity::none, factory);
+    EXPECT_EQ(int(undeclared.getError()), int(ExpressionParser::Error::unknownChar));
+    ExpressionParser missingOp("2 x", ExpressionParser::Verbosity::none, factory, &names);
+    EXPECT_EQ(int(missingOp.getError()), int(ExpressionParser::Error::missingOp));
+
+    ExpressionParser parser("-x^2 + y2 * sin(rate) - x / (1 + rate) + pi", ExpressionParser::Verbosity::none,
+                            factory, &names);
+    EXPECT_TRUE(parser.finishedOK());
+    CompiledExpression program(parser.getTree());
+    EXPECT_EQ(program.getVariableCount(), 3u);
+
+    const size_t count = 37; // not a multiple of the batch lanes.
+    std::vector<double> xs(count), ys(count), rates(count), results(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        xs[i] = 0.25 * i;
+        ys[i] = 3.0 - i;
+        rates[i] = 0.01 * i * i;
+    }
+
+    const double* arrays[3] = {xs.data(), ys.data(), rates.data()};
+    program.evaluate(arrays, results.data(), count);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double values[3] = {xs[i], ys[i], rates[i]};
+        double expected = ArithmeticEvaluator(parser.getTree(), values).getResult();
+        if (results[i] != expected || program.evaluate(values) != expected)
+            mismatches++;
+    }
+
+    EXPECT_Z(mismatches);
+}
+
+// The functions in long double (a true cube root for curt), to measure the ULP error of the double ones.
+static long double exactFunction(OperationId id, long double x)
+{
+    switch (id)
+    {
+    case OperationId::sin:     return sinl(x);
+    case OperationId::cos:     return cosl(x);
+    case OperationId::tan:     return tanl(x);
+    case OperationId::sinh:    return sinhl(x);
+    case OperationId::cosh:    return coshl(x);
+    case OperationId::tanh:    return tanhl(x);
+    case OperationId::exp:     return expl(x);
+    case OperationId::asin:    return asinl(x);
+    case OperationId::acos:    return acosl(x);
+    case OperationId::atan:    return atanl(x);
+    case OperationId::asinh:   return asinhl(x);
+    case OperationId::acosh:   return acoshl(x);
+    case OperationId::atanh:   return atanhl(x);
+    case OperationId::ln:      return logl(x);
+    case OperationId::log10:   return log10l(x);
+    case OperationId::log2:    return log2l(x);
+    case OperationId::sqrroot: return sqrtl(x);
+    case OperationId::cubroot: return cbrtl(x);
+    case OperationId::gamma:   return tgammal(x);
+    default:                   return 0;
+    }
+}
+
+void vectorMathTests(TEST_REF)
+{
+    std::vector<double> xs; // over many magnitudes, the dense interval around 0 and the edges of the domains.
+    for (int i = -3000; i <= 3000; i++)
+        xs.push_back(i / 997.0);
+    for (int i = -700; i <= 700; i++)
+        xs.push_back(copysign(exp(i + 0.318), (i % 3 == 0 ? -1.0 : 1.0)));
+    for (double edge : {0.0, -0.0, 1.0, -1.0, 0.5, 2.0, 3.0, 10.0, 1e-300, 708.0, 709.5, 1e6, 1e7, 1e300, HUGE_VAL})
+        xs.push_back(edge);
+
+    for (size_t f = static_cast<size_t>(OperationId::firstFunction); f <= static_cast<size_t>(OperationId::lastFunction);
+         f++)
+    {
+        OperationId id = static_cast<OperationId>(f);
+        std::vector<double> in;
+        for (double x : xs)
+            if (id != OperationId::sqrroot || x >= 0) // a negative square root asserts.
+                in.push_back(x);
+
+        std::vector<double> out(in.size());
+        VectorMath::evaluate(id, in.data(), out.data(), in.size());
+        double worst = 0;
+        int misses = 0;
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            double scalar = ArithmeticEvaluator::operate(id, 0.0, in[i]);
+            long double exact = exactFunction(id, in[i]);
+            if (std::isnan(scalar) || std::isinf(scalar) || fabsl(exact) > DBL_MAX || scalar == 0)
+                misses += (memcmp(&out[i], &scalar, sizeof(double)) != 0 && !(std::isnan(out[i]) && std::isnan(scalar))
+                           && !(out[i] == 0 && scalar == 0)); // the special values are left to the scalar code.
+            else
+            {
+                int exponent = 0;
+                frexp(static_cast<double>(exact), &exponent);
+                double ulp = ldexp(1.0, std::max(exponent - 53, -1074));
+                worst = std::max(worst, static_cast<double>(fabsl(out[i] - exact) / ulp));
+            }
+        }
+
+        EXPECT_Z(misses);
+        EXPECT_LE(worst, VectorMath::getMaxUlpError(id));
+    }
+
+    std::vector<double> inPlace = {0.5, -2.25, 1e10, 3.0}; // sin(1e10) out of the kernel's domain.
+    std::vector<double> expected;
+    for (double x : inPlace)
+        expected.push_back(ArithmeticEvaluator::operate(OperationId::sin, 0.0, x));
+    VectorMath::evaluate(OperationId::sin, inPlace.data(), inPlace.data(), inPlace.size());
+    EXPECT_EQ(inPlace[2], expected[2]);
+    EXPECT_LE(fabs(inPlace[1] - expected[1]), 1e-15);
+
+    ExpressionParser::VariableNames names = {"x"};
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser parser("sin(x) * exp(-x/3) + ln(x + 2) - atan(x) / gama(x + 1.5)",
+                            ExpressionParser::Verbosity::none, factory, &names);
+    CompiledExpression program(parser.getTree());
+    const size_t count = 37; // not a multiple of the batch lanes.
+    std::vector<double> points(count), results(count), vectorResults(count);
+    for (size_t i = 0; i < count; i++)
+        points[i] = 0.2 * i - 1.3;
+
+    const double* arrays[1] = {points.data()};
+    program.evaluate(arrays, results.data(), count);
+    program.evaluate(arrays, vectorResults.data(), count, true);
+    double worstDifference = 0;
+    for (size_t i = 0; i < count; i++)
+        worstDifference = std::max(worstDifference, fabs(vectorResults[i] - results[i]) / fabs(results[i]));
+    EXPECT_LE(worstDifference, 1e-14);
+}
+
+void vectorPrecisionTests(TEST_REF)
+{
+    using Precision = VectorMath::Precision;
+    EXPECT_TRUE(VectorMath::choosePrecision(1e-3) == Precision::low);
+    EXPECT_TRUE(VectorMath::choosePrecision(1e-6) == Precision::medium);
+    EXPECT_TRUE(VectorMath::choosePrecision(1e-11) == Precision::high);
+    EXPECT_TRUE(VectorMath::choosePrecision(1e-13) == Precision::full);
+    EXPECT_TRUE(VectorMath::choosePrecision(0.0) == Precision::full);
+    EXPECT_LW(VectorMath::getMaxError(Precision::medium), VectorMath::getMaxError(Precision::low));
+    EXPECT_LW(VectorMath::getMaxError(Precision::full), VectorMath::getMaxError(Precision::high));
+
+    std::vector<double> xs; // as vectorMathTests(), plus the zeros of sin, cos and tan, and the logarithms near 1.
+    for (int i = -3000; i <= 3000; i++)
+        xs.push_back(i / 997.0);
+    for (int i = -700; i <= 700; i++)
+        xs.push_back(copysign(exp(i + 0.318), (i % 3 == 0 ? -1.0 : 1.0)));
+    for (int k = -40; k <= 40; k++)
+        xs.push_back(k * 1.5707963267948966 + 1e-7);
+    for (int i = -50; i <= 50; i++)
+        xs.push_back(1.0 + i * 1e-5);
+    for (double edge : {0.0, -0.0, 1.0, -1.0, 0.5, 2.0, 3.0, 10.0, 1e-300, 708.0, 709.5, 1e6, 1e7, 1e300, HUGE_VAL})
+        xs.push_back(edge);
+
+    for (Precision precision : {Precision::low, Precision::medium, Precision::high})
+        for (size_t f = static_cast<size_t>(OperationId::firstFunction);
+             f <= static_cast<size_t>(OperationId::lastFunction); f++)
+        {
+            OperationId id = static_cast<OperationId>(f);
+            std::vector<double> in;
+            for (double x : xs)
+                if (id != OperationId::sqrroot || x >= 0)
+                    in.push_back(x);
+
+            std::vector<double> out(in.size());
+            VectorMath::evaluate(id, in.data(), out.data(), in.size(), precision);
+            double worst = 0;
+            int misses = 0;
+            for (size_t i = 0; i < in.size(); i++)
+            {
+                double scalar = ArithmeticEvaluator::operate(id, 0.0, in[i]);
+                long double exact = exactFunction(id, in[i]);
+                if (std::isnan(scalar) || std::isinf(scalar) || fabsl(exact) > DBL_MAX || scalar == 0)
+                    misses += (memcmp(&out[i], &scalar, sizeof(double)) != 0
+                               && !(std::isnan(out[i]) && std::isnan(scalar)) && !(out[i] == 0 && scalar == 0));
+                else
+                    worst = std::max(worst, static_cast<double>(fabsl((out[i] - exact) / exact)));
+            }
+
+            EXPECT_Z(misses);
+            EXPECT_LE(worst, VectorMath::getMaxError(precision));
+        }
+
+    ExpressionParser::VariableNames names = {"x"};
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser parser("exp(-x/3) * (2 + sin(x)) + ln(x + 2) * cosh(x)", ExpressionParser::Verbosity::none,
+                            factory, &names);
+    CompiledExpression program(parser.getTree());
+    const size_t count = 37;
+    std::vector<double> points(count), results(count), fastResults(count);
+    for (size_t i = 0; i < count; i++)
+        points[i] = 0.2 * i - 1.3;
+
+    const double* arrays[1] = {points.data()};
+    program.evaluate(arrays, results.data(), count);
+    program.evaluate(arrays, fastResults.data(), count, true, Precision::medium);
+    double worstDifference = 0;
+    for (size_t i = 0; i < count; i++)
+        worstDifference = std::max(worstDifference, fabs(fastResults[i] - results[i]) / fabs(results[i]));
+    EXPECT_LE(worstDifference, 2 * VectorMath::getMaxError(Precision::medium)); // terms of the same sign.
+    EXPECT_GT(worstDifference, 0.0); // not the full precision kernels.
+}
+
+void gammaFunctionTests(TEST_REF)
+{
+    double product = 1; // exact up to 22!.
+    for (size_t n = 0; n <= 22; n++)
+    {
+        product *= (n > 0 ? n : 1);
+        EXPECT_EQ(GammaFunction::factorial(static_cast<double>(n)), product);
+        EXPECT_EQ(GammaFunction::gamma(n + 1.0), product);
+    }
+
+    EXPECT_EQ(GammaFunction::factorial(170), GammaFunction::factorialOf(170));
+    EXPECT_LE(GammaFunction::factorial(170), DBL_MAX);
+    EXPECT_EQ(GammaFunction::factorial(171), HUGE_VAL); // overflows instead of wrapping around.
+    EXPECT_EQ(GammaFunction::factorial(1e10), HUGE_VAL);
+    EXPECT_LE(GammaFunction::factorial(170.5), DBL_MAX); // gamma(171.5), still finite.
+    EXPECT_EQ(GammaFunction::gamma(GammaFunction::maxArgument + 0.01), HUGE_VAL);
+    EXPECT_LE(fabs(GammaFunction::factorial(2.5) / (1.875 * sqrt(M_PI)) - 1), 1e-15); // not 2! any more.
+    EXPECT_EQ(GammaFunction::factorial(-1), HUGE_VAL); // gamma(0), a pole.
+    EXPECT_EQ(GammaFunction::gamma(-0.0), -HUGE_VAL);
+    EXPECT_TRUE(std::isnan(GammaFunction::gamma(-3)));
+    EXPECT_TRUE(std::isnan(GammaFunction::gamma(-HUGE_VAL)));
+    EXPECT_TRUE(std::isnan(GammaFunction::factorial(NAN)));
+    EXPECT_EQ(GammaFunction::gamma(HUGE_VAL), HUGE_VAL);
+    EXPECT_EQ(GammaFunction::gamma(-200.5), tgamma(-200.5)); // underflowing.
+    EXPECT_LE(fabs(GammaFunction::gamma(-171.5) / tgamma(-171.5) - 1), 1e-9); // subnormal, not 0.
+    EXPECT_LE(fabs(GammaFunction::gamma(-170.645) / tgamma(-170.645) - 1), 1e-12);
+
+    double worst = 0; // within the few ULP of tgamma() everywhere: the recurrence, Stirling and the reflection.
+    for (int i = -1716; i <= 1716; i++)
+    {
+        double x = i / 10.0 + 0.0123;
+        long double exact = tgammal(x);
+        int exponent = 0;
+        frexp(static_cast<double>(exact), &exponent);
+        double ulp = ldexp(1.0, std::max(exponent - 53, -1074));
+        worst = std::max(worst, static_cast<double>(fabsl(GammaFunction::gamma(x) - exact) / ulp));
+    }
+    EXPECT_LE(worst, 8.0);
+
+    for (size_t n = 1; n <= GammaFunction::maxFactorial; n++) // every entry, n times the previous one.
+        EXPECT_LE(fabs(GammaFunction::factorialOf(n) / GammaFunction::factorialOf(n - 1) / n - 1), 3 * DBL_EPSILON);
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    ExpressionParser parser("(3.5!) - gama(4.5) + (171!) - (20!)", ExpressionParser::Verbosity::none, factory);
+    EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), HUGE_VAL);
+    ExpressionParser exact("(20!) - 2432902008176640000 + ((-0.5)!) ^ 2", ExpressionParser::Verbosity::none, factory);
+    EXPECT_LE(fabs(ArithmeticEvaluator(exact.getTree()).getResult() - M_PI), 1e-14);
+}
+
+void constantFoldingTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory; // heap, so every released node is accounted.
+    ExpressionParser::VariableNames names = {"x"};
+    ExpressionParser parser("2*pi + x * (3+4)^2 - sqrt(2) + 1 + ", ExpressionParser::Verbosity::none,
+                            factory, &names);
+    EXPECT_TRUE(parser.finishedOK());
+
+    double x[1] = {1.5};
+    double expected = ArithmeticEvaluator(parser.getTree(), x).getResult();
+    size_t nodesBefore = factory.getLiveNodes();
+
+    TreeOptimizer optimizer(parser.getTree(), factory);
+    size_t removed = optimizer.foldConstants();
+    EXPECT_EQ(removed, size_t(7)); // 2 pi, 3 4, then 7 2, and the 2 of sqrt; the sums over x stay.
+    EXPECT_EQ(factory.getLiveNodes(), nodesBefore - removed);
+    EXPECT_EQ(ArithmeticEvaluator(parser.getTree(), x).getResult(), expected); // bit for bit.
+    EXPECT_Z(optimizer.foldConstants()); // nothing left to fold.
+
+    ExpressionParser constant("-2^2 + (5!) / 3 % 7", ExpressionParser::Verbosity::none, factory);
+    expected = ArithmeticEvaluator(constant.getTree()).getResult();
+    TreeOptimizer(constant.getTree(), factory).foldConstants();
+    const Node<OperationItem>* pRoot = constant.getTree()->getRoot();
+    EXPECT_TRUE(pRoot->getData().id == OperationId::number && pRoot->getLeft() == nullptr
+                && pRoot->getRight() == nullptr);
+    EXPECT_EQ(pRoot->getData().value, expected);
+
+    std::string nested, closing(100000, ')'); // folded and released without recursion, whatever the depth.
+    for (int i = 0; i < 100000; i++)
+        nested += "sin(";
+
+    ExpressionParser deepConstant((nested + "1" + closing).c_str(), ExpressionParser::Verbosity::none, factory);
+    expected = ArithmeticEvaluator(deepConstant.getTree()).getResult();
+    EXPECT_EQ(TreeOptimizer(deepConstant.getTree(), factory).foldConstants(), size_t(100000));
+    EXPECT_EQ(deepConstant.getTree()->getRoot()->getData().value, expected);
+
+    ExpressionParser deepVariable((nested + "x*(3+4)" + closing).c_str(), ExpressionParser::Verbosity::none,
+                                  factory, &names);
+    EXPECT_EQ(TreeOptimizer(deepVariable.getTree(), factory).foldConstants(), size_t(2));
+}
+
+void subexpressionSharingTests(TEST_REF)
+{
+    NodeFactory<OperationItem> factory; // heap, so the destruction of a DAG is checked too.
+    ExpressionParser::VariableNames names = {"a", "b"};
+    {
+        ExpressionParser parser("sin(a*b) + cos(a*b) * (a*b) - 2^3 * a / (2^3)", ExpressionParser::Verbosity::none,
+                                factory, &names);
+        EXPECT_TRUE(parser.finishedOK());
+
+        double values[2] = {0.75, -1.25};
+        double expected = ArithmeticEvaluator(parser.getTree(), values).getResult();
+        size_t nodesBefore = factory.getLiveNodes();
+
+        TreeOptimizer optimizer(parser.getTree(), factory);
+        EXPECT_EQ(optimizer.foldConstants(), size_t(4)); // the two 2^3 are folded first.
+        EXPECT_EQ(optimizer.shareSubexpressions(), size_t(8)); // two a*b (3 nodes each), the last a and 8.
+        EXPECT_EQ(factory.getLiveNodes(), nodesBefore - optimizer.getRemovedNodes());
+        EXPECT_Z(optimizer.shareSubexpressions()); // already a DAG without duplicates.
+
+        EXPECT_EQ(ArithmeticEvaluator(parser.getTree(), values).getResult(), expected); // bit for bit.
+        CompiledExpression program(parser.getTree());
+        EXPECT_EQ(program.getSharedCount(), size_t(1)); // a*b, leaves are just pushed.
+        EXPECT_EQ(program.evaluate(values), expected);
+
+        const size_t count = 21;
+        std::vector<double> as(count), bs(count), results(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            as[i] = 0.1 * i;
+            bs[i] = 2.0 - 0.3 * i;
+        }
+
+        const double* arrays[2] = {as.data(), bs.data()};
+        program.evaluate(arrays, results.data(), count);
+        int mismatches = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            double point[2] = {as[i], bs[i]};
+            if (results[i] != ArithmeticEvaluator(parser.getTree(), point).getResult())
+                mismatches++;
+        }
+
+        EXPECT_Z(mismatches);
+    }
+
+    EXPECT_Z(factory.getLiveNodes()); // every DAG node destroyed once, by its owner.
+
+    std::string negations(100, '-'); // below the levels destroyed by recursion.
+    for (const std::string& expression : {std::string("(a+1)/(a+1)"), negations + "(b*b)"})
+    {
+        ExpressionParser parser(expression.c_str(), ExpressionParser::Verbosity::none, factory, &names);
+        TreeOptimizer optimizer(parser.getTree(), factory);
+        EXPECT_NZ(optimizer.shareSubexpressions());
+    }
+
+    std::string nested, closing(100000, ')'); // shared without recursion, whatever the depth.
+    for (int i = 0; i < 100000; i++)
+        nested += "sin(";
+    {
+        ExpressionParser parser((nested + "a*b + b*a + a*b" + closing).c_str(), ExpressionParser::Verbosity::none,
+                                factory, &names);
+        EXPECT_EQ(TreeOptimizer(parser.getTree(), factory).shareSubexpressions(), size_t(5)); // a and b twice, the last a*b.
+    }
+
+    EXPECT_Z(factory.getLiveNodes()); // a node both operands of its parent, destroyed once too.
+}
+
+void expressionCacheTests(TEST_REF)
+{
+    EXPECT_EQ(ExpressionCache::normalize(" 1 + \t2 * 3\n", 13), ExpressionCache::normalize("1 + 2 * 3", 9));
+    EXPECT_NEQ(ExpressionCache::normalize("1 2", 3), ExpressionCache::normalize("12", 2)); // spaces end the items.
+    EXPECT_NEQ(ExpressionCache::normalize("si n(0)", 7), ExpressionCache::normalize("sin(0)", 6));
+    EXPECT_NEQ(ExpressionCache::normalize("1e 3", 4), ExpressionCache::normalize("1e3", 3));
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    std::string keys[4];
+    const char* expressions[4] = {"2*x + 1", "1 + x*2", "1 - x*2", "x*2 - 1"};
+    ExpressionParser::VariableNames names = {"x"};
+    for (int i = 0; i < 4; i++)
+    {
+        ExpressionParser parser(expressions[i], ExpressionParser::Verbosity::none, factory, &names);
+        keys[i] = ExpressionCache::canonicalForm(parser.getTree());
+    }
+
+    EXPECT_EQ(keys[0], keys[1]); // + and * operands swapped.
+    EXPECT_NEQ(keys[2], keys[3]); // - is not commutative.
+    EXPECT_NEQ(keys[0], ExpressionCache::normalize("2*x+1", 5)); // text and canonical keys never collide.
+
+    std::string negations(100000, '-'); // a key built without recursion, whatever the depth.
+    for (int i = 0; i < 2; i++)
+    {
+        std::string deep = negations + '(' + expressions[i] + ')';
+        ExpressionParser parser(deep.c_str(), ExpressionParser::Verbosity::none, factory, &names);
+        keys[i] = ExpressionCache::canonicalForm(parser.getTree());
+    }
+
+    EXPECT_EQ(keys[0], keys[1]);
+
+    ExpressionCache cache(2, 1); // a single shard, so the LRU order is exact.
+    ExpressionCache::Entry entry = {0.0, nullptr};
+    cache.insert("a", {1.0, nullptr});
+    cache.insert("b", {2.0, nullptr});
+    EXPECT_TRUE(cache.find("a", entry) && entry.result == 1.0); // now "b" is the least recently used.
+    cache.insert("c", {3.0, nullptr});
+    EXPECT_FALSE(cache.find("b", entry, false)); // not counted, another key is tried next.
+    EXPECT_FALSE(cache.find("b", entry));
+    EXPECT_TRUE(cache.find("c", entry) && entry.result == 3.0);
+
+    ExpressionCache::Statistics stats = cache.getStatistics();
+    EXPECT_EQ(stats.hits, uint64_t(2));
+    EXPECT_EQ(stats.misses, uint64_t(1));
+    EXPECT_EQ(stats.evictions, uint64_t(1));
+    EXPECT_EQ(stats.entries, size_t(2));
+
+    ExpressionCache shared(64);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrongResults(0);
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&shared, &wrongResults] () {
+            for (int i = 0; i < 2000; i++)
+            {
+                std::string key = std::to_string(i % 100);
+                ExpressionCache::Entry e;
+                if (!shared.find(key, e))
+                    shared.insert(key, {double(i % 100), nullptr});
+                else if (e.result != double(i % 100))
+                    wrongResults++;
+            }
+        });
+
+    for (std::thread& t : threads)
+        t.join();
+
+    stats = shared.getStatistics();
+    EXPECT_Z(wrongResults.load());
+    EXPECT_EQ(stats.hits + stats.misses, uint64_t(4 * 2000));
+    EXPECT_TRUE(stats.entries <= shared.getCapacity() && stats.evictions > 0);
+
+    ExpressionCache bounded(100); // 16 shards, the capacity is still a total.
+    for (int i = 0; i < 1000; i++)
+        bounded.insert(std::to_string(i), {double(i), nullptr});
+
+    EXPECT_EQ(bounded.getStatistics().entries, size_t(100));
+}
+
+void phaseStatisticsTests(TEST_REF)
+{
+    PhaseStatistics::Histogram h = {};
+    for (uint64_t ns = 1; ns <= 10000; ns++)
+        h.record(ns);
+
+    EXPECT_EQ(h.count, uint64_t(10000));
+    EXPECT_EQ(h.maxNs, uint64_t(10000));
+    EXPECT_TRUE(5000 <= h.percentile(0.5) && h.percentile(0.5) <= 5000 * 1.0625); // the bucket error.
+    EXPECT_TRUE(9900 <= h.percentile(0.99) && h.percentile(0.99) <= 10000);
+    EXPECT_EQ(h.percentile(1.0), uint64_t(10000));
+
+    PhaseStatistics stats;
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    PhaseStatistics::current() = &stats;
+    {
+        ExpressionParser parser("1 + 2 * sin(3)", ExpressionParser::Verbosity::none, factory);
+        ArithmeticEvaluator evaluator(parser.getTree());
+    }
+    PhaseStatistics::current() = nullptr;
+    {
+        ExpressionParser parser("1 + 2", ExpressionParser::Verbosity::none, factory); // not measured.
+        ArithmeticEvaluator evaluator(parser.getTree());
+    }
+
+    EXPECT_EQ(stats.getHistogram(PhaseStatistics::Phase::tokenizing).count, uint64_t(1));
+    EXPECT_EQ(stats.getHistogram(PhaseStatistics::Phase::treeBuilding).count, uint64_t(1));
+    EXPECT_EQ(stats.getHistogram(PhaseStatistics::Phase::evaluation).count, uint64_t(1));
+    EXPECT_Z(stats.getHistogram(PhaseStatistics::Phase::output).count);
+
+    PhaseStatistics merged;
+    merged.merge(stats);
+    merged.merge(stats);
+    EXPECT_EQ(merged.getHistogram(PhaseStatistics::Phase::evaluation).count, uint64_t(2));
+}
+
+void multithreadTests(TEST_REF)
+{
+    static const char* expressions[4] =
+    {
+        "3+4*(2+1*1*(4-(1+1)))-(9 + 7)", "(4 + 5 * (7 - 3)) - 2", "2 * 3 * 4 * 5 - 5!", "1*2*3*(2-1/3)"
+    };
+    const double expected[4] = {3, 22, 0, 10};
+    const int threadCount = 4;
+    std::vector<int> mismatches(threadCount, 0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++)
+        threads.emplace_back([t, &expected, &mismatches] () {
+            NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena); // one per thread.
+            for (int i = 0; i < 2000; i++)
+            {
+                ExpressionParser parser(expressions[(t + i) % 4], ExpressionParser::Verbosity::none, factory);
+                if (!parser.finishedOK() || ArithmeticEvaluator(parser.getTree()).getResult() != expected[(t + i) % 4])
+                    mismatches[t]++;
+            }
+        });
+
+    for (std::thread& th : threads)
+        th.join();
+
+    for (int t = 0; t < threadCount; t++)
+        EXPECT_Z(mismatches[t]);
+}
+
+void workStealingPoolTests(TEST_REF)
+{
+    WorkStealingPool pool(4);
+    EXPECT_EQ(pool.getWorkerCount(), 4u);
+
+    for (int batch = 0; batch < 2; batch++) // the same workers run consecutive batches.
+    {
+        const size_t count = 10007;
+        std::vector<std::atomic<int>> runs(count);
+        for (std::atomic<int>& r : runs)
+            r = 0;
+
+        pool.start(count, [&runs] (size_t index, unsigned) {runs[index]++;});
+        pool.wait();
+
+        int wrong = 0;
+        for (std::atomic<int>& r : runs)
+            if (r != 1)
+                wrong++;
+
+        EXPECT_Z(wrong); // every task ran exactly once.
+    }
+}
+
+void lineReaderTests(TEST_REF)
+{
+    char path[] = "/tmp/calc-test-XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_GE(fd, 0);
+    FILE* pFile = fdopen(fd, "w");
+    fputs("1+1\n\n 2*3\r\n4-5", pFile); // empty line skipped, CR removed, last line without LF.
+    fclose(pFile);
+
+    NodeFactory<OperationItem> factory(NodeFactory<OperationItem>::Allocation::arena);
+    const double expected[3] = {2, 6, -1};
+    std::vector<LineReader::Line> lines;
+    LineReader reader;
+    EXPECT_TRUE(reader.open(path));
+    EXPECT_TRUE(reader.isMapped());
+
+    int count = 0;
+    while (reader.readLines(lines, 2) > 0)
+    {
+        for (const LineReader::Line& line : lines)
+        {
+            ExpressionParser parser(line.text, line.length, ExpressionParser::Verbosity::none, factory);
+            EXPECT_TRUE(parser.finishedOK());
+            EXPECT_EQ(ArithmeticEvaluator(parser.getTree()).getResult(), expected[count++]);
+        }
+    }
+
+    EXPECT_EQ(count, 3);
+    EXPECT_TRUE(reader.open(path, true)); // the empty line kept this time.
+    EXPECT_EQ(reader.readLines(lines, 10), size_t(4));
+    EXPECT_Z(lines[1].length);
+    reader.close();
+    remove(path);
+
+    int pipeFds[2];
+    EXPECT_Z(pipe(pipeFds));
+    const int pipedLines = 200000; // over the 1 MiB buffer, so that lines straddle its end.
+    std::thread writer([&] () {
+        FILE* pPipe = fdopen(pipeFds[1], "w");
+        for (int i = 0; i < pipedLines; i++)
+            fprintf(pPipe, i % 1000 == 999 ? "\n" : "%d + 0.5\n", i); // an empty line every 1000.
+        fclose(pPipe);
+    });
+
+    std::string pipePath = "/dev/fd/" + std::to_string(pipeFds[0]); // a stream, never mapped.
+    EXPECT_TRUE(reader.open(pipePath.c_str(), true));
+    EXPECT_FALSE(reader.isMapped());
+    int piped = 0, wrong = 0;
+    while (reader.readLines(lines, 1) > 0) // a line at a time, as calc -i reads them, the empty ones too.
+    {
+        if (piped % 1000 == 999)
+        {
+            wrong += (lines[0].length != 0);
+            piped++;
+            continue;
+        }
+
+        ExpressionParser parser(lines[0].text, lines[0].length, ExpressionParser::Verbosity::none, factory);
+        wrong += (ArithmeticEvaluator(parser.getTree()).getResult() != piped++ + 0.5);
+    }
+
+    writer.join();
+    reader.close();
+    close(pipeFds[0]);
+    EXPECT_EQ(piped, pipedLines);
+    EXPECT_Z(wrong);
+
+    ExpressionParser bounded("1+2345", 3, ExpressionParser::Verbosity::none, factory); // just "1+2"
+    EXPECT_TRUE(bounded.finishedOK());
+    EXPECT_EQ(ArithmeticEvaluator(bounded.getTree()).getResult(), 3);
+}
+
+// The output of bin/calc run with the arguments (from the project directory, as make runs the tests),
+// and its exit status.
+static std::string runCalc(const std::string& arguments, int& status)
+{
+    std::string output;
+    FILE* pPipe = popen(("bin/calc " + arguments + " 2>&1").c_str(), "r");
+    if (pPipe == nullptr)
+    {
+        status = -1;
+        return output;
+    }
+
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), pPipe) != nullptr)
+        output += buffer;
+
+    int waitStatus = pclose(pPipe);
+    status = (WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : -1);
+    return output;
+}
+
+void commandLineTests(TEST_REF)
+{
+    int status;
+    std::string output = runCalc("-j 1+1 2*3", status); // a bare -j, followed by expressions.
+    EXPECT_Z(status);
+    EXPECT_NEQ(output.find("Expression #1 : Result = 2"), std::string::npos);
+    EXPECT_NEQ(output.find("Expression #2 : Result = 6"), std::string::npos);
+
+    output = runCalc("-j -2+3", status);
+    EXPECT_Z(status);
+    EXPECT_NEQ(output.find("Expression #1 : Result = 1"), std::string::npos);
+
+    output = runCalc("-j 2 1+1 2*3", status);
+    EXPECT_Z(status);
+    EXPECT_NEQ(output.find("Expression #2 : Result = 6"), std::string::npos);
+
+    output = runCalc("-c 100 12 '1 2' 'sin(0)' 'si n(0)' 1e3 '1e 3'", status); // the cache gives what the parser does.
+    EXPECT_EQ(status, EXIT_FAILURE);
+    EXPECT_NEQ(output.find("Expression #2 : Result = 2\n"), std::string::npos);
+    EXPECT_NEQ(output.find("Expression #4 : ERROR 7"), std::string::npos);
+    EXPECT_EQ(output.find("Expression #6 : Result = 1000"), std::string::npos);
+
+    output = runCalc("-jfoo 1+1", status);
+    EXPECT_EQ(status, EXIT_FAILURE);
+    EXPECT_NEQ(output.find("ERROR in the thread count"), std::string::npos);
+
+    const char* badErrors[] = {"abc", "-1", "0", "inf", "nan", "1e-6x"};
+    for (const char* badError : badErrors)
+    {
+        output = runCalc(std::string("-precision ") + badError + " x=0:1:0.5 'sin(x)'", status);
+        EXPECT_EQ(status, EXIT_FAILURE);
+        EXPECT_NEQ(output.find("ERROR in the relative error"), std::string::npos);
+    }
+
+    output = runCalc("-precision 1e-6 x=0:1:0.5 'sin(x)'", status);
+    EXPECT_Z(status);
+    EXPECT_NEQ(output.find("Tabulated functions within a relative error"), std::string::npos);
+}
 
 int main()
 {
     START_TESTS;
 
     nodeTests(TEST);
+    slotRecyclingTests(TEST);
+    arenaTests(TEST);
     badParsingTests(TEST);
+    tokenizerTests(TEST);
+    parserEngineTests(TEST);
+    deepTreeTests(TEST);
+    treeVisitorTests(TEST);
+    numberParsingTests(TEST);
+    functionNameTests(TEST);
     parseAndEvaluatorTests(TEST);
+    compiledExpressionTests(TEST);
+    compactTreeTests(TEST);
+    jitExpressionTests(TEST);
+    constexprExpressionTests(TEST);
+    variableTests(TEST);
+    vectorMathTests(TEST);
+    vectorPrecisionTests(TEST);
+    gammaFunctionTests(TEST);
+    constantFoldingTests(TEST);
+    subexpressionSharingTests(TEST);
+    expressionCacheTests(TEST);
+    phaseStatisticsTests(TEST);
+    multithreadTests(TEST);
+    workStealingPoolTests(TEST);
+    lineReaderTests(TEST);
+    commandLineTests(TEST);
 
-    NodeFactory<OperationItem>::destroyInstance();
     PRINT_RESULTS(std::cout);
 }
 